@@ -351,7 +351,6 @@ void randomClean(float duration)
  */
 void endChime()
 {
-	const float NOTE_C = 554.37;
 	const float NOTE_D = 587.33;
 	const float NOTE_E = 659.25;
 	const float NOTE_F = 739.99;
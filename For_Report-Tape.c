@@ -10,7 +10,10 @@ will used a weighted random turn navigation algorithm to clean at least 90% of t
 room.
 */
 
-#include <UW_sensorMux.c>
+#define MUX_PERIOD 50	// ms between SMUX reads, collisions come from the bump counters
+#include <UW_sensorTask.c>
+#include <UW_manhattan.c>
+#include <UW_frontier.c>
 
 // Motor ports
 tMotor motorLeft = motorA;
@@ -27,11 +30,107 @@ tMotor motorDrum = motorB;
 #define lTouch msensor_S4_2
 #define rTouch msensor_S4_3
 
+// telemetryState values
+#define STATE_SETUP 0
+#define STATE_EDGE 1
+#define STATE_CLEAN 2
+#define STATE_BACK_OFF 3
+#define STATE_ROTATE 4
+#define STATE_DONE 5
+#define STATE_LANE 6
+#define STATE_FRONTIER 7
+
+// control loop timers
+#define LOOP_DRIVE 0
+#define LOOP_ROTATE 1
+#define LOOP_WIDE_TURN 2
+#define LOOP_EDGE 3
+#define LOOP_CLEAN 4
+#define LOOP_LANE 5
+
+// cleaning modes, picked at startup
+#define MODE_RANDOM 0	// bump and turn at random
+#define MODE_LANES 1	// back and forth in lanes, then at random
+#define MODE_FRONTIER 2	// at random, going to the nearest unswept floor when no new floor turns up
+#define NUMB_OF_MODES 3
+
 // constants
 #define FWD_SPEED 30	// standard movement speed
 #define TURN_SPEED 10 	// standard turn speed
 #define RADIUS 4		//  wheel radius
+#define BUMPER_OFFSET 12	// cm from the robot's centre to the front bumpers
+#define ULTRASONIC_OFFSET 12	// cm from the robot's centre to the ultrasonic sensor
+#define COLOUR_OFFSET 8		// cm from the robot's centre to the colour sensor
+#define DRUM_WIDTH 20		// cm swept across the robot
+#define DRUM_DEPTH 4		// cm of floor under the drum along the robot
 #define DRUM_SPRAY_SPEED 60
+#define CORNER_SPEED 60	// cruise speed of the short moves around corners, profiled
+#define DISPLAY_PERIOD 1000	// ms between redraws of a reading that keeps changing
+
+// lanes: the step between them, the drum's width less an overlap for heading error, how far the robot
+// backs off a wall before turning at the end of one, and a distance past any wall
+#define LANE_SPACING 16
+#define LANE_BACK_OFF 5
+#define LANE_FAR 10000
+
+// randomClean() turns: how many are weighed, spread evenly over 90 to 269 degrees, how far along each
+// the coverage map is looked at, and the weight of a turn with nothing left to sweep (that of 5 unswept
+// cells), which keeps every turn possible so the robot can get out of traps. The weights must add up to
+// less than rand()'s 32767, which a 150 cm ray keeps them to.
+#define TURN_CHOICES 12
+#define TURN_RAY 150
+#define TURN_BASE_WEIGHT 25
+
+// why driveLane() stopped
+#define LANE_END 0
+#define LANE_BUMP 1
+#define LANE_TAPE 2
+#define LANE_DONE 3	// cleaningDone()
+
+#define TARGET_STEP 5	// percent the target coverage steps by at startup
+// percent the map's coverage must clear the target by: the map only outlines the floor swept, so it
+// runs ahead of the true coverage while parts of the room are still unreached
+#define TARGET_MARGIN 6
+
+// frontier mode: local cleaning has saturated when it sweeps fewer than FRONTIER_GAIN new cells of the
+// map in FRONTIER_WINDOW tenths of a second, a fifth of what the drum sweeps driving straight over new
+// floor
+#define FRONTIER_WINDOW 300
+#define FRONTIER_GAIN 100
+
+// heading hold while driving straight: motor power of steering per degree of heading error, per degree
+// second of accumulated error and per degree per second of gyro rate
+#define HOLD_KP 1.0
+#define HOLD_KI 0.5
+#define HOLD_KD 0.05
+#define HOLD_INTEGRAL_MAX 20	// degree seconds
+
+// driveDistance() profile: wheel acceleration and deceleration in degrees per second squared, the
+// power every move starts and ends on, the wheel speed a unit of power gives and how long the robot
+// keeps rolling once the motors are cut, which the move stops early for
+#define PROFILE_ACCEL 2000
+#define PROFILE_DECEL 2000
+#define PROFILE_MIN_POWER 8
+#define DEG_PER_SEC_PER_POWER 10.2
+#define PROFILE_STOP_LAG 0.05	// s
+
+// turn profile: robot acceleration and deceleration in degrees per second squared, the power turns
+// start and end on and cruise at, and the rate a unit of power turns the robot on the spot (a wide turn
+// on one wheel goes half as fast)
+#define TURN_ACCEL 600
+#define TURN_DECEL 600
+#define TURN_MIN_POWER 6
+#define TURN_MAX_POWER 40
+#define TURN_DEG_PER_SEC_PER_POWER 5.8
+#define TURN_STOP_LAG 0.05	// s
+
+bool headingHold = true;	// steer straight drives onto the heading they started on
+bool motionProfile = true;	// ramp driveDistance() moves up and down instead of running them at full power
+bool turnProfile = true;	// ramp turns up and down instead of running them at TURN_SPEED
+int holdPower = 0;			// power drive() was last asked for
+float holdHeading;			// gyro heading the current drive started on
+float holdIntegral;
+long holdTime;				// snapshot timestamp of the last correction
 
 /**
  * @brief Configures all sensors
@@ -68,67 +167,250 @@ void configureAllSensors()
 }
 
 /**
- * @brief Drive robot at specified power/direction
+ * @brief Change the power of the current drive, staying on the heading it started on
  *
  * @param mPower motor power (-100 to 100) negative for driving in reverse
  */
-void drive(int mPower)
+void setDrivePower(int mPower)
 {
+	holdPower = mPower;
+
 	// negative because motor orientation is reversed on robot
 	motor[motorLeft] = motor[motorRight] = -mPower; 
 }
 
+/**
+ * @brief Drive robot at specified power/direction
+ *
+ * A change of power starts a new straight line on the current heading, which holdStraight() keeps to.
+ * @param mPower motor power (-100 to 100) negative for driving in reverse
+ */
+void drive(int mPower)
+{
+	if (mPower != holdPower)
+	{
+		tSensorSnapshot sensors;
+		getSensorSnapshot(sensors);
+		holdHeading = sensors.heading;
+		holdIntegral = 0;
+		holdTime = sensors.timestamp;
+	}
+	setDrivePower(mPower);
+}
+
+/**
+ * @brief Steer the current drive back onto the heading it started on
+ *
+ * PID on the gyro heading, with the gyro rate as the derivative. Call once per control loop iteration
+ * while driving; does nothing while stopped or with headingHold off.
+ * @param sensors the latest snapshot
+ */
+void holdStraight(tSensorSnapshot &sensors)
+{
+	if (!headingHold || holdPower == 0)
+		return;
+
+	float dt = (sensors.timestamp - holdTime) / 1000.0;
+	holdTime = sensors.timestamp;
+
+	// clockwise drift is corrected by running the right wheel ahead of the left, in either direction
+	float error = sensors.heading - holdHeading;
+	holdIntegral += error * dt;
+	if (holdIntegral > HOLD_INTEGRAL_MAX)
+		holdIntegral = HOLD_INTEGRAL_MAX;
+	else if (holdIntegral < -HOLD_INTEGRAL_MAX)
+		holdIntegral = -HOLD_INTEGRAL_MAX;
+
+	float steer = HOLD_KP * error + HOLD_KI * holdIntegral + HOLD_KD * sensors.rate;
+	float limit = abs(holdPower) / 2.0;
+	if (steer > limit)
+		steer = limit;
+	else if (steer < -limit)
+		steer = -limit;
+
+	motor[motorLeft] = -round(holdPower - steer);
+	motor[motorRight] = -round(holdPower + steer);
+}
+
 /**
  * @brief Drive robot a specified distance
  *
+ * With motionProfile the power ramps up from PROFILE_MIN_POWER, cruises at mPower and comes down again
+ * in time to stop at the distance, and the motors are cut early by the distance the robot will roll on
+ * at the speed it is doing.
  * @param distance distance for robot to drive in cm (negative for backwards)
  * @param mPower motor power (positive number 0-100)
  */
 void driveDistance(int distance, int mPower)
 {
 	const float CM_TO_DEG = 180 / (RADIUS * PI);
-	nMotorEncoder[motorLeft] = 0;
+	float target = abs(distance * CM_TO_DEG);
+	int direction = distance > 0 ? 1 : -1;
+	tSensorSnapshot sensors;
+
+	// the pose task needs the encoders, so they are never reset
+	long startLeft = recordedEncoder(motorLeft);
+	long startRight = recordedEncoder(motorRight);
 	
-	if (distance > 0)
-		drive(mPower);
-	else
-		drive(-mPower);
+	drive(direction * (motionProfile ? PROFILE_MIN_POWER : mPower));
 
-	while (abs(nMotorEncoder[motorLeft]) < abs(distance * CM_TO_DEG));
+	long startTime = nSysTime;
+	long lastTime = startTime;
+	float lastTravelled = 0;
+	float speed = 0;	// wheel degrees per second
+
+	long nextTick;
+	startControlLoop(nextTick, LOOP_DRIVE);
+	while (true)
+	{
+		// the wheels run at different speeds while steering, so go by their average
+		float travelled = (abs(recordedEncoder(motorLeft) - startLeft) +
+			abs(recordedEncoder(motorRight) - startRight)) / 2.0;
+		float remaining = target - travelled;
+
+		if (!motionProfile)
+		{
+			if (remaining <= 0)
+				break;
+		}
+		else
+		{
+			long now = nSysTime;
+			if (now > lastTime)
+			{
+				speed = (travelled - lastTravelled) * 1000.0 / (now - lastTime);
+				lastTime = now;
+				lastTravelled = travelled;
+			}
+
+			// on average the motors are cut half a control period after the ideal moment
+			if (remaining <= speed * (PROFILE_STOP_LAG + CONTROL_PERIOD / 2000.0))
+				break;
+
+			float power = PROFILE_MIN_POWER + PROFILE_ACCEL * (now - startTime) / 1000.0 / DEG_PER_SEC_PER_POWER;
+			float braking = sqrt(2 * PROFILE_DECEL * remaining) / DEG_PER_SEC_PER_POWER;
+			if (power > braking)
+				power = braking;
+			if (power > mPower)
+				power = mPower;
+			if (power < PROFILE_MIN_POWER)
+				power = PROFILE_MIN_POWER;
+			setDrivePower(direction * round(power));
+		}
+
+		getSensorSnapshot(sensors);
+		holdStraight(sensors);
+		waitForControlTick(nextTick, LOOP_DRIVE);
+	}
 
 	drive(0);
 }
 
+/**
+ * @brief Power for the next control tick of a turn
+ *
+ * With turnProfile the power ramps up from TURN_MIN_POWER to TURN_MAX_POWER and comes down again in time
+ * to stop at the angle, and the turn ends early by the angle the robot will coast through at the rate
+ * the gyro measures. The braking is planned to where the coast will start, not to the angle itself, so
+ * a long spin is slow by then and the tick the motors are cut on matters little. Otherwise the turn runs
+ * at TURN_SPEED until the angle is reached.
+ * @param remaining degrees still to turn
+ * @param rate gyro rate, degrees per second
+ * @param elapsed ms since the turn started
+ * @param degPerSecPerPower rate a unit of power turns the robot at
+ * @return power to turn at, 0 once the motors should be cut
+ */
+int turnPower(float remaining, float rate, long elapsed, float degPerSecPerPower)
+{
+	if (!turnProfile)
+		return remaining > 0 ? TURN_SPEED : 0;
+
+	// on average the motors are cut half a control period after the ideal moment
+	if (remaining <= abs(rate) * (TURN_STOP_LAG + CONTROL_PERIOD / 2000.0))
+		return 0;
+
+	float power = TURN_MIN_POWER + TURN_ACCEL * elapsed / 1000.0 / degPerSecPerPower;
+	float coast = abs(rate) * TURN_STOP_LAG;
+	float braking = remaining > coast ? sqrt(2 * TURN_DECEL * (remaining - coast)) / degPerSecPerPower : 0;
+	if (power > braking)
+		power = braking;
+	if (power > TURN_MAX_POWER)
+		power = TURN_MAX_POWER;
+	if (power < TURN_MIN_POWER)
+		power = TURN_MIN_POWER;
+	return round(power);
+}
+
+/**
+ * @brief Mark on the coverage map what the front bumpers hit
+ *
+ * @param pose the pose the bumpers hit at
+ * @param touch MUX_BIT()s of the bumpers that hit
+ */
+void chartBumps(tPose &pose, int touch)
+{
+	bool left = (touch & MUX_BIT(lTouch)) != 0;
+	bool right = (touch & MUX_BIT(rTouch)) != 0;
+	float ahead = BUMPER_OFFSET + MAP_CELL / 2.0;
+
+	if (left && right)
+		chartObstacle(pose, ahead, 0);
+	else if (left)
+		chartObstacle(pose, ahead, BUMPER_OFFSET / 2.0);
+	else if (right)
+		chartObstacle(pose, ahead, -BUMPER_OFFSET / 2.0);
+}
+
 /**
  * @brief Rotate robot with collision detection
+ *
+ * The drum stops for the turn and starts again when it ends, whether it completed or not.
  * @author Ryan Bernstein
  * @param angle target angle to turn in degrees
  * @return true if turn completed, false if collision
  */
 bool smartRotateRobot(int angle, int tapeColour)
 {
-	resetGyro(gyro);
+	tSensorSnapshot sensors;
+	getSensorSnapshot(sensors);
+	float startHeading = sensors.heading;
+	int direction = angle > 0 ? 1 : -1;
 	motor[motorDrum] = 0;
 
-	if (angle > 0)
-	{
-		motor[motorLeft] = TURN_SPEED;
-		motor[motorRight] = -1 * TURN_SPEED;
-	}
-	else
+	// only readings taken after the turn started count, and only bumpers that were not already down, as
+	// the robot may still be against the obstacle it is turning away from or rubbing along a wall
+	long startTime = nSysTime;
+	int held = sensors.touch;
+	long nextTick;
+	startControlLoop(nextTick, LOOP_ROTATE);
+	getCollisions(sensors);
+	while (true)
 	{
-		motor[motorRight] = TURN_SPEED;
-		motor[motorLeft] = -1 * TURN_SPEED;
-	}
+		int power = turnPower(abs(angle) - abs(sensors.heading - startHeading), sensors.rate,
+			nSysTime - startTime, TURN_DEG_PER_SEC_PER_POWER);
+		if (power == 0)
+			break;
+		motor[motorLeft] = direction * power;
+		motor[motorRight] = -direction * power;
 
-	while (abs(getGyroDegrees(gyro)) < abs(angle))
-	{
-		if (readMuxSensor(lTouch) == 1 || readMuxSensor(rTouch) == 1 ||
-			readMuxSensor(sTouch) == 1 || SensorValue[color] == tapeColour)
+		int collisions = getCollisions(sensors);
+		held &= sensors.touch;
+		bool bumped = sensors.touchTime >= startTime && ((sensors.touch & ~held) != 0 || collisions != 0);
+		bool onTape = sensors.timestamp >= startTime && sensors.colour == tapeColour;
+		if (bumped || onTape)
 		{
 			drive(0);
+			tPose pose;
+			getPose(pose);
+			if (bumped)
+				chartBumps(pose, sensors.touch | collisions);
+			if (onTape)
+				chartObstacle(pose, COLOUR_OFFSET, 0);
+			motor[motorDrum] = DRUM_SPRAY_SPEED;
 			return false;
 		}
+		waitForControlTick(nextTick, LOOP_ROTATE);
+		getSensorSnapshot(sensors);
 	}
 	drive(0);
 	motor[motorDrum] = DRUM_SPRAY_SPEED;
@@ -142,13 +424,28 @@ bool smartRotateRobot(int angle, int tapeColour)
  */
 void rotateRobotWide(int angle)
 {
-	resetGyro(gyro);
+	tSensorSnapshot sensors;
+	getSensorSnapshot(sensors);
+	float startHeading = sensors.heading;
 	motor[motorDrum] = 0;
-	if (angle > 0)
-		motor[motorRight] = -1 * TURN_SPEED;
-	else
-		motor[motorLeft] = -1 * TURN_SPEED;
-	while (abs(getGyroDegrees(gyro)) < abs(angle));
+
+	long startTime = nSysTime;
+	long nextTick;
+	startControlLoop(nextTick, LOOP_WIDE_TURN);
+	while (true)
+	{
+		int power = turnPower(abs(angle) - abs(sensors.heading - startHeading), sensors.rate,
+			nSysTime - startTime, TURN_DEG_PER_SEC_PER_POWER / 2);
+		if (power == 0)
+			break;
+		if (angle > 0)
+			motor[motorRight] = -1 * power;
+		else
+			motor[motorLeft] = -1 * power;
+
+		waitForControlTick(nextTick, LOOP_WIDE_TURN);
+		getSensorSnapshot(sensors);
+	}
 	motor[motorDrum] = DRUM_SPRAY_SPEED;
 	drive(0);
 }
@@ -160,13 +457,28 @@ void rotateRobotWide(int angle)
  */
 void rotateRobotBackwardsWide(int angle)
 {
-	resetGyro(gyro);
+	tSensorSnapshot sensors;
+	getSensorSnapshot(sensors);
+	float startHeading = sensors.heading;
 	motor[motorDrum] = 0;
-	if (angle > 0)
-		motor[motorLeft] = TURN_SPEED;
-	else
-		motor[motorRight] = TURN_SPEED;
-	while (abs(getGyroDegrees(gyro)) < abs(angle));
+
+	long startTime = nSysTime;
+	long nextTick;
+	startControlLoop(nextTick, LOOP_WIDE_TURN);
+	while (true)
+	{
+		int power = turnPower(abs(angle) - abs(sensors.heading - startHeading), sensors.rate,
+			nSysTime - startTime, TURN_DEG_PER_SEC_PER_POWER / 2);
+		if (power == 0)
+			break;
+		if (angle > 0)
+			motor[motorLeft] = power;
+		else
+			motor[motorRight] = power;
+
+		waitForControlTick(nextTick, LOOP_WIDE_TURN);
+		getSensorSnapshot(sensors);
+	}
 	motor[motorDrum] = DRUM_SPRAY_SPEED;
 	drive(0);
 }
@@ -201,9 +513,9 @@ int getTapeColour()
 		// runs until colour sensor detects same colour for 2 seconds (to avoid detecting random colours in set up)
 		while (true)
 		{
-			tapeColour = SensorValue(color);
+			tapeColour = recordedSensorValue(color);
 			wait1Msec(2000);
-			if (getColorName(color) == tapeColour)
+			if (recordedSensorValue(color) == tapeColour)
 				break;
 			else
 				tapeColour = (int)(colorRed);
@@ -214,19 +526,19 @@ int getTapeColour()
 		displayString(12, "Up = Accept, Down = Retry");
 
 		// runs until either up or down is pressed
-		while (!(getButtonPress(buttonUp) || getButtonPress(buttonDown)));
+		while (!(recordedButtonPress(buttonUp) || recordedButtonPress(buttonDown)));
 
 		// breaks loop if up is pressed
-		if (getButtonPress(buttonUp))
+		if (recordedButtonPress(buttonUp))
 		{
-			while (getButtonPress(buttonUp));
+			while (recordedButtonPress(buttonUp));
 			eraseDisplay();
 			break;
 		}
 		// continues running if down is pressed
 		else
 		{
-			while (getButtonPress(buttonDown));
+			while (recordedButtonPress(buttonDown));
 			eraseDisplay();
 		}
 	}
@@ -245,7 +557,7 @@ int getEdges()
 	int edges = 4;
 
 	// waits until enter is pressed
-	while (!getButtonPress(buttonEnter))
+	while (!recordedButtonPress(buttonEnter))
 	{
 		// displays message and number of edges
 		eraseDisplay();
@@ -256,23 +568,23 @@ int getEdges()
 		displayString(10, "Number of edges: %d", edges);
 
 		// waits until either button is pressed
-		while (!(getButtonPress(buttonUp) || getButtonPress(buttonDown) ||
-				 getButtonPress(buttonEnter)));
+		while (!(recordedButtonPress(buttonUp) || recordedButtonPress(buttonDown) ||
+				 recordedButtonPress(buttonEnter)));
 
-		if (getButtonPress(buttonUp)) // increment if up is pressed
+		if (recordedButtonPress(buttonUp)) // increment if up is pressed
 		{
-			while (getButtonPress(buttonUp));
+			while (recordedButtonPress(buttonUp));
 			edges++;
 		}
 		else // decrement if down is pressed
 		{
-			while (getButtonPress(buttonDown));
+			while (recordedButtonPress(buttonDown));
 			if (edges > 4)
 				edges--;
 		}
 	}
 
-	while (getButtonPress(buttonEnter));
+	while (recordedButtonPress(buttonEnter));
 	eraseDisplay();
 	wait1Msec(100);
 	return edges;
@@ -288,7 +600,7 @@ float getDuration()
 	float duration = 0.0;
 
 	// waits until enter is pressed
-	while (!getButtonPress(buttonEnter))
+	while (!recordedButtonPress(buttonEnter))
 	{
 		// displays message and duration
 		eraseDisplay();
@@ -299,32 +611,130 @@ float getDuration()
 		displayString(10, "Duration: %d mins", (int)duration);
 
 		// waits until either button is pressed
-		while (!(getButtonPress(buttonUp) || getButtonPress(buttonDown) ||
-				 getButtonPress(buttonEnter)));
+		while (!(recordedButtonPress(buttonUp) || recordedButtonPress(buttonDown) ||
+				 recordedButtonPress(buttonEnter)));
 
 		// increments if up is pressed
-		if (getButtonPress(buttonUp))
+		if (recordedButtonPress(buttonUp))
 		{
-			while (getButtonPress(buttonUp));
+			while (recordedButtonPress(buttonUp));
 			duration++;
 		}
 
 		// decrements if down is pressed
 		else
 		{
-			while (getButtonPress(buttonDown));
+			while (recordedButtonPress(buttonDown));
 			if (duration > 0)
 				duration--;
 		}
 	}
 
 	// wait until enter is released then erase display
-	while (getButtonPress(buttonEnter));
+	while (recordedButtonPress(buttonEnter));
 	eraseDisplay();
 	wait1Msec(100);
 	return duration;
 }
 
+/**
+ * @brief Get target coverage from user
+ *
+ * Cleaning stops once the coverage map puts the room's coverage TARGET_MARGIN past the target, or at
+ * the end of the duration, which becomes a time cap. The target is an estimate from the map, not a
+ * measurement. With no target the robot cleans for the whole duration.
+ * @return percent, 0 for no target
+ */
+int getTargetCoverage()
+{
+	eraseDisplay();
+	int target = 0;
+
+	// waits until enter is pressed
+	while (!recordedButtonPress(buttonEnter))
+	{
+		eraseDisplay();
+		displayString(3, "Enter target coverage:");
+		displayString(4, "- Up to increment");
+		displayString(5, "- Down for decrement");
+		displayString(6, "- Enter to confirm");
+		if (target == 0)
+			displayString(10, "Target coverage: none");
+		else
+			displayString(10, "Target coverage: %d%%", target);
+		displayString(11, "(estimated from map)");
+
+		// waits until either button is pressed
+		while (!(recordedButtonPress(buttonUp) || recordedButtonPress(buttonDown) ||
+				 recordedButtonPress(buttonEnter)));
+
+		if (recordedButtonPress(buttonUp))
+		{
+			while (recordedButtonPress(buttonUp));
+			if (target < 100)
+				target += TARGET_STEP;
+		}
+		else if (recordedButtonPress(buttonDown))
+		{
+			while (recordedButtonPress(buttonDown));
+			if (target > 0)
+				target -= TARGET_STEP;
+		}
+	}
+
+	while (recordedButtonPress(buttonEnter));
+	eraseDisplay();
+	wait1Msec(100);
+	return target;
+}
+
+/**
+ * @brief Get cleaning mode from user
+ *
+ * @return MODE_RANDOM, MODE_LANES or MODE_FRONTIER
+ */
+int getCleanMode()
+{
+	eraseDisplay();
+	int mode = MODE_RANDOM;
+
+	// waits until enter is pressed
+	while (!recordedButtonPress(buttonEnter))
+	{
+		eraseDisplay();
+		displayString(3, "Choose cleaning mode");
+		displayString(4, "- Up for next mode");
+		displayString(5, "- Down for previous mode");
+		displayString(6, "- Enter to confirm");
+		if (mode == MODE_LANES)
+			displayString(10, "Cleaning mode: lanes");
+		else if (mode == MODE_FRONTIER)
+			displayString(10, "Cleaning mode: frontier");
+		else
+			displayString(10, "Cleaning mode: random");
+
+		// waits until either button is pressed
+		while (!(recordedButtonPress(buttonUp) || recordedButtonPress(buttonDown) ||
+				 recordedButtonPress(buttonEnter)));
+
+		if (recordedButtonPress(buttonUp))
+		{
+			while (recordedButtonPress(buttonUp));
+			mode = (mode + 1) % NUMB_OF_MODES;
+		}
+		else if (recordedButtonPress(buttonDown))
+		{
+			while (recordedButtonPress(buttonDown));
+			mode = (mode + NUMB_OF_MODES - 1) % NUMB_OF_MODES;
+		}
+	}
+
+	while (recordedButtonPress(buttonEnter));
+	eraseDisplay();
+	wait1Msec(100);
+	return mode;
+}
+
 /**
  * @brief Display instructions to user and waits for user to press enter to start the
  *  	  robot
@@ -336,8 +746,8 @@ void waitForStartConfirmation()
 	displayString(7, "starting position and press");
 	displayString(8, "enter to start.");
 	wait1Msec(100);
-	while (!getButtonPress(buttonEnter));
-	while (getButtonPress(buttonEnter));
+	while (!recordedButtonPress(buttonEnter));
+	while (recordedButtonPress(buttonEnter));
 }
 
 /**
@@ -350,34 +760,78 @@ void sweepEdge(int edges, int tapeColour)
 {
 	const int ULTRASONIC_WALL_DIST = 20;
 	bool alongTape = false;
+	bool wallSeen;			// the wall being followed has been in range on this edge
+	bool steppedOff;		// the robot has stepped off the end of a wall on this edge
 	int cornerType = 0; // 0 = none, 1 = inside corner, 2 = outside corner,  
 						// 3 = wall to tape
+	tSensorSnapshot sensors;
+	tPose pose;
+	int shownDistance;		// range on the screen, and when it was drawn
+	long shownTime = 0;
 
+	telemetryState = STATE_EDGE;
 	for (int counter = 0; counter < edges; counter++)
 	{
 		cornerType = 0;
+		wallSeen = false;
+		steppedOff = false;
+		shownDistance = -1;
 		drive(FWD_SPEED);
+		long nextTick;
+		startControlLoop(nextTick, LOOP_EDGE);
 
 		while (cornerType == 0)
 		{
-			if (readMuxSensor(lTouch) == 1 || readMuxSensor(rTouch) == 1)
+			getSensorSnapshot(sensors);
+			getPose(pose);
+			if (sensors.distance <= ULTRASONIC_WALL_DIST)
+				wallSeen = true;
+			if ((sensors.touch & (MUX_BIT(lTouch) | MUX_BIT(rTouch))) == MUX_BIT(rTouch)
+				&& sensors.distance <= ULTRASONIC_WALL_DIST && !steppedOff)
+			{
+				// the right bumper alone may have caught the end of the wall being rubbed, which goes on
+				// round an outside corner: step off it to the left and carry on along the same edge, and if
+				// the robot bumps again it was a corner after all
+				steppedOff = true;
+				drive(0);
+				driveDistance(-10, CORNER_SPEED);
+				rotateRobotWide(30);
+				driveDistance(10, CORNER_SPEED);
+				rotateRobotWide(-30);
+				drive(FWD_SPEED);
+				startControlLoop(nextTick, LOOP_EDGE);
+				continue;
+			}
+			if ((sensors.touch & (MUX_BIT(lTouch) | MUX_BIT(rTouch))) != 0)
 			{
+				manhattanCorner(pose, BUMPER_OFFSET);
+				chartBumps(pose, sensors.touch);
 				cornerType = 1;
 				displayString(11, "inside corner  ");
 			}
-			else if (!alongTape && SensorValue[ultrasonic] > ULTRASONIC_WALL_DIST)
+			else if (!alongTape && wallSeen && sensors.distance > ULTRASONIC_WALL_DIST)
 			{
+				manhattanCorner(pose, -1);
 				cornerType = 2;
 				displayString(11, "outside corner ");
 			}
-			else if (SensorValue[color] == tapeColour)
+			else if (sensors.colour == tapeColour)
 			{
+				manhattanCorner(pose, -1);
+				chartObstacle(pose, COLOUR_OFFSET, 0);
 				cornerType = 3;
 				displayString(11, "tape corner    ");
 			}
 
-			displayString(10, "Dist: %d", SensorValue[ultrasonic]);
-			wait1Msec(20);
+			if (sensors.distance != shownDistance && nSysTime - shownTime >= DISPLAY_PERIOD)
+			{
+				shownDistance = sensors.distance;
+				shownTime = nSysTime;
+				displayString(10, "Dist: %d   ", shownDistance);
+			}
+			manhattanSide(sensors, pose);
+			holdStraight(sensors);
+			waitForControlTick(nextTick, LOOP_EDGE);
 		}
 
 		drive(0);
@@ -387,17 +841,17 @@ void sweepEdge(int edges, int tapeColour)
 
 		if (cornerType == 2) // outside corners
 		{
-			driveDistance(5, FWD_SPEED);
+			driveDistance(5, CORNER_SPEED);
 			rotateRobotWide(-90);
-			driveDistance(10, FWD_SPEED);
+			driveDistance(10, CORNER_SPEED);
 		}
 		else // inside corners
 		{
-			driveDistance(-15, FWD_SPEED);
+			driveDistance(-15, CORNER_SPEED);
 			rotateRobotWide(90);
-			driveDistance(5, FWD_SPEED);
+			driveDistance(5, CORNER_SPEED);
 			rotateRobotBackwardsWide(45);
-			driveDistance(-5, FWD_SPEED);
+			driveDistance(-5, CORNER_SPEED);
 			rotateRobotBackwardsWide(-45);
 		}
 		
@@ -408,44 +862,327 @@ void sweepEdge(int edges, int tapeColour)
 	}
 }
 
+/**
+ * @brief Whether to stop cleaning: the time is up or the coverage has reached the target
+ *
+ * The map's figure has to clear the target by TARGET_MARGIN, so that the true coverage reaches it.
+ * @param duration time cap, minutes of time100[T1]
+ * @param target coverage to stop at, percent, 0 for none
+ */
+bool cleaningDone(float duration, int target)
+{
+	return time100[T1] >= duration * 600 || (target > 0 && getRoomCoverage() >= target + TARGET_MARGIN);
+}
+
+/**
+ * @brief Pick a turn at random, weighted towards the floor left to sweep
+ *
+ * Each of TURN_CHOICES sectors of 90 to 269 degrees puts forward a turn drawn at random within it, weighed
+ * by the square of the unswept cells on the coverage map along the new heading, so that open floor
+ * clearly wins over a few cells missed along a wall.
+ * @return degrees to turn, counter-clockwise
+ */
+int weightedTurn()
+{
+	const int SECTOR = 180 / TURN_CHOICES;
+	int angles[TURN_CHOICES];
+	long weights[TURN_CHOICES];
+	long total = 0;
+	tPose pose;
+	getPose(pose);
+
+	for (int i = 0; i < TURN_CHOICES; i++)
+	{
+		angles[i] = 90 + i * SECTOR + recordedRand() % SECTOR;
+		long unswept = countUnswept(pose.x, pose.y, pose.heading + angles[i], TURN_RAY);
+		weights[i] = TURN_BASE_WEIGHT + unswept * unswept;
+		total += weights[i];
+	}
+
+	long pick = recordedRand() % total;
+	for (int i = 0; i < TURN_CHOICES - 1; i++)
+	{
+		if (pick < weights[i])
+			return angles[i];
+		pick -= weights[i];
+	}
+	return angles[TURN_CHOICES - 1];
+}
+
+/**
+ * @brief Turn on the spot to a heading of the pose frame, the short way round
+ *
+ * @param heading degrees counter-clockwise from the way the robot faced at the start
+ * @param tapeColour Color of border tape
+ * @return false if the turn was stopped by a collision
+ */
+bool turnTo(float heading, int tapeColour)
+{
+	tPose pose;
+	getPose(pose);
+	float angle = heading - pose.heading;
+	angle -= round(angle / 360) * 360;
+	return smartRotateRobot(round(angle), tapeColour);
+}
+
+/**
+ * @brief Drive along a heading until a bump, the tape, a distance or cleaningDone()
+ *
+ * The heading is held from the pose rather than from wherever the turn onto it stopped. The turns stop
+ * within a degree or two of their angle, but the errors would add up from lane to lane, and the pose
+ * also carries the Manhattan corrections of the gyro's drift, so the lanes stay parallel to the room.
+ * @param heading degrees counter-clockwise, of the pose frame
+ * @param distance cm to drive at most
+ * @param duration time cap, minutes of time100[T1]
+ * @param target coverage to stop at, percent, 0 for none
+ * @param tapeColour Color of border tape
+ * @return LANE_END, LANE_BUMP, LANE_TAPE or LANE_DONE
+ */
+int driveLane(float heading, float distance, float duration, int target, int tapeColour)
+{
+	tSensorSnapshot sensors;
+	tPose pose;
+	getPose(pose);
+	float start = pose.distance;
+	getSensorSnapshot(sensors);
+	getCollisions(sensors);
+
+	// the gyro heading is clockwise, and the pose heading unwrapped, so hold the short way round to it
+	float offset = heading - pose.heading;
+	offset -= round(offset / 360) * 360;
+	drive(FWD_SPEED);
+	holdHeading = sensors.heading - offset;
+	long nextTick;
+	startControlLoop(nextTick, LOOP_LANE);
+	while (true)
+	{
+		getSensorSnapshot(sensors);
+		getPose(pose);
+		// the side bumper rubs along walls the lanes run beside, only the front ones end a lane
+		int touch = (sensors.touch | getCollisions(sensors)) & (MUX_BIT(lTouch) | MUX_BIT(rTouch));
+		if (touch != 0)
+		{
+			drive(0);
+			manhattanAhead(pose);
+			chartBumps(pose, touch);
+			return LANE_BUMP;
+		}
+		if (sensors.colour == tapeColour)
+		{
+			drive(0);
+			chartObstacle(pose, COLOUR_OFFSET, 0);
+			return LANE_TAPE;
+		}
+		if (pose.distance - start >= distance)
+		{
+			drive(0);
+			return LANE_END;
+		}
+		if (cleaningDone(duration, target))
+		{
+			drive(0);
+			return LANE_DONE;
+		}
+
+		manhattanSide(sensors, pose);
+		holdStraight(sensors);
+		waitForControlTick(nextTick, LOOP_LANE);
+	}
+	return LANE_END;
+}
+
+/**
+ * @brief Drive the waypoints planFrontier() left, turning on the spot at each
+ *
+ * @param duration time cap, minutes of time100[T1]
+ * @param target coverage to stop at, percent, 0 for none
+ * @param tapeColour Color of border tape
+ * @return false if a bump or the tape stopped the robot on the way, or cleaning is done
+ */
+bool followPath(float duration, int target, int tapeColour)
+{
+	tPose pose;
+	displayString(7, "Exploring ... ");
+
+	for (int i = 0; i < frontierWaypoints; i++)
+	{
+		getPose(pose);
+		float dx = frontierPathX[i] - pose.x;
+		float dy = frontierPathY[i] - pose.y;
+		float heading = atan2(dy, dx) * 180 / PI;
+		if (!turnTo(heading, tapeColour) ||
+			driveLane(heading, sqrt(dx * dx + dy * dy), duration, target, tapeColour) != LANE_END)
+			return false;
+	}
+	return true;
+}
+
 /**
  * @brief Randomly moves around room to clean room
+ *
+ * Drives until a bump, backs off and turns by weightedTurn(), until cleaningDone(). Exploring, a bump
+ * after a FRONTIER_WINDOW that swept little new floor sends the robot to the nearest frontier instead.
  * @author Ryan Bernstein
+ * @param duration time cap, minutes of time100[T1]
+ * @param target coverage to stop at, percent, 0 for none
+ * @param explore go to frontiers
+ * @param tapeColour Color of border tape
  */
-void randomClean(float duration, int tapeColour)
+void randomClean(float duration, int target, bool explore, int tapeColour)
 {
 	bool rotationCollision = false;
-	while (time100[T1] < duration * 600)
+	tSensorSnapshot sensors;
+	tPose pose;
+	long nextTick;
+	startControlLoop(nextTick, LOOP_CLEAN);
+	long windowStart = time100[T1];
+	long windowSwept = mapSweptCells;
+	int covered = -1;	// percentage on the screen, drawn again only when it changes
+
+	// bumps while following the edges were dealt with there, and the walls have all been seen
+	telemetryState = STATE_CLEAN;
+	manhattanLearning = false;
+	getSensorSnapshot(sensors);
+	getCollisions(sensors);
+	displayString(7, "Cleaning ... ");
+
+	while (!cleaningDone(duration, target))
 	{
-		displayString(7, "Cleaning ... ");
+		int percent = (int)getRoomCoverage();
+		if (percent != covered)
+		{
+			covered = percent;
+			displayString(8, "Covered %d%%  ", covered);
+		}
 		drive(FWD_SPEED);
-		if (readMuxSensor(rTouch) == 1 || readMuxSensor(lTouch) == 1 ||
-			readMuxSensor(sTouch) == 1 || rotationCollision)
+		getSensorSnapshot(sensors);
+		getPose(pose);
+		int collisions = getCollisions(sensors);
+		if (sensors.touch != 0 || collisions != 0 || rotationCollision)
 		{
 			drive(0);
+			if (((sensors.touch | collisions) & (MUX_BIT(lTouch) | MUX_BIT(rTouch))) != 0)
+				manhattanAhead(pose);
+			chartBumps(pose, sensors.touch | collisions);
+			telemetryState = STATE_BACK_OFF;
 			drive(-FWD_SPEED / 2);
 			wait1Msec(2000);
-			rotationCollision = !smartRotateRobot(90 + rand() % 180, tapeColour);
+
+			bool saturated = false;
+			if (explore && time100[T1] - windowStart >= FRONTIER_WINDOW)
+			{
+				saturated = mapSweptCells - windowSwept < FRONTIER_GAIN;
+				windowStart = time100[T1];
+				windowSwept = mapSweptCells;
+			}
+			getPose(pose);
+			if (saturated && planFrontier(pose))
+			{
+				telemetryState = STATE_FRONTIER;
+				rotationCollision = !followPath(duration, target, tapeColour);
+				displayString(7, "Cleaning ... ");
+			}
+			else
+			{
+				telemetryState = STATE_ROTATE;
+				rotationCollision = !smartRotateRobot(weightedTurn(), tapeColour);
+			}
+			telemetryState = STATE_CLEAN;
+			startControlLoop(nextTick, LOOP_CLEAN);
 		}
-		wait1Msec(100);
+		else
+		{
+			manhattanSide(sensors, pose);
+			holdStraight(sensors);
+		}
+		waitForControlTick(nextTick, LOOP_CLEAN);
 	}
 }
 
+/**
+ * @brief Clean the room back and forth in lanes along its x axis
+ *
+ * Moves to the first lane, half a lane off the wall found below the robot while following the edges,
+ * then runs lanes to a bump or the tape at either end, stepping LANE_SPACING cm up the room between them,
+ * until the wall above it or something in the way of a step. The strips along the walls were swept with
+ * the edges, and whatever lies behind obstacles is left for randomClean(), as is the rest of the room if
+ * a bump or the tape stops a turn onto a lane, since the robot is then off the lanes, and the whole room
+ * if no pair of walls closes it above and below the robot (UW_manhattan.c's wallsAround()).
+ * @param duration time cap, minutes of time100[T1]
+ * @param target coverage to stop at, percent, 0 for none
+ * @param tapeColour Color of border tape
+ */
+void laneClean(float duration, int target, int tapeColour)
+{
+	tPose pose;
+	float low, high;
+
+	telemetryState = STATE_LANE;
+	manhattanLearning = false;
+	// the edges end in a corner, up to a body's radius past the stretches of wall seen from it
+	getPose(pose);
+	if (!wallsAround(1, pose.y, pose.x, -BUMPER_OFFSET, low, high))
+		return;
+	float top = high - BUMPER_OFFSET - LANE_SPACING / 2;
+	float bottom = low + BUMPER_OFFSET + LANE_SPACING / 2;
+
+	float down = pose.y > bottom ? -90 : 90;
+	if (!turnTo(down, tapeColour))
+		return;
+	if (driveLane(down, abs(pose.y - bottom), duration, target, tapeColour) == LANE_DONE)
+		return;
+
+	// start towards the far end of the room
+	getPose(pose);
+	float along = 0;
+	if (wallsAround(0, pose.x, pose.y, -BUMPER_OFFSET, low, high) && pose.x - low > high - pose.x)
+		along = 180;
+
+	while (true)
+	{
+		if (!turnTo(along, tapeColour))
+			return;
+		if (driveLane(along, LANE_FAR, duration, target, tapeColour) == LANE_DONE)
+			return;
+		driveDistance(-LANE_BACK_OFF, CORNER_SPEED);
+
+		getPose(pose);
+		if (pose.y + LANE_SPACING > top)
+			return;
+		if (!turnTo(90, tapeColour))
+			return;
+		if (driveLane(90, LANE_SPACING, duration, target, tapeColour) != LANE_END)
+			return;
+		along = 180 - along;
+	}
+}
+
+/**
+ * @brief Display how much of the room was cleaned and how long it took
+ *
+ * @param elapsed cleaning time, in tenths of a second of time100[T1]
+ */
+void showResult(long elapsed)
+{
+	long seconds = elapsed / 10;
+	eraseDisplay();
+	displayString(7, "Roboting Complete");
+	displayString(8, "Covered %d%%", (int)getRoomCoverage());
+	displayString(9, "Time %d:%02d", (int)(seconds / 60), (int)(seconds % 60));
+	writeDebugStreamLine("covered %d%% in %d s", (int)getRoomCoverage(), (int)seconds);
+}
+
 /**
  * @brief Play end chime
  * @author Jerry Chen
  */
 void endChime()
 {
-	const float NOTE_C = 554.37;
 	const float NOTE_D = 587.33;
 	const float NOTE_E = 659.25;
 	const float NOTE_F = 739.99;
 	const float NOTE_G = 783.99;
 	const float NOTE_A = 880;
-	
-	eraseDisplay();
-	displayString(7, "Roboting Complete");
 
 	int beatLength = 25;
 	int wait = 200;
@@ -475,14 +1212,24 @@ task main()
 	int edges = 4;
 	float duration = 1.0;
 	int tapeColour = 0;
+	int target = 0;
+	int mode = MODE_RANDOM;
 
 	configureAllSensors();
+	startRecorder("uwclean.rec", ultrasonic, color);
 	splashScreen();
 	tapeColour = getTapeColour();
 	edges = getEdges();
 	duration = getDuration();
+	target = getTargetCoverage();
+	mode = getCleanMode();
 	waitForStartConfirmation();
 	configureAllSensors();
+	startSensorTask(ultrasonic, gyro, color);
+	startPoseTask(motorLeft, motorRight, -RADIUS * PI / 180);
+	startManhattan(BUMPER_OFFSET, ULTRASONIC_OFFSET);
+	startCoverageMap(motorDrum, DRUM_WIDTH, DRUM_DEPTH, ULTRASONIC_OFFSET);
+	startTelemetry(motorLeft, motorRight, TELEMETRY_PERIOD);
 
 	motor[motorDrum] = DRUM_SPRAY_SPEED;
 	motor[motorSpray] = DRUM_SPRAY_SPEED;
@@ -490,10 +1237,25 @@ task main()
 	time100[T1] = 0;
 
 	sweepEdge(edges, tapeColour);
-	randomClean(duration, tapeColour);
+	if (mode == MODE_LANES)
+		laneClean(duration, target, tapeColour);
+	randomClean(duration, target, mode == MODE_FRONTIER, tapeColour);
 
 	motor[motorDrum] = 0;
 	motor[motorSpray] = 0;
+	long elapsed = time100[T1];
 
+	telemetryState = STATE_DONE;
+	sleep(TELEMETRY_PERIOD);
+	saveTelemetry("uwclean.tlm");
+	stopRecorder();
+	dumpLoopTiming(LOOP_DRIVE, "driveDistance");
+	dumpLoopTiming(LOOP_ROTATE, "smartRotateRobot");
+	dumpLoopTiming(LOOP_WIDE_TURN, "rotateRobotWide");
+	dumpLoopTiming(LOOP_EDGE, "sweepEdge");
+	dumpLoopTiming(LOOP_CLEAN, "randomClean");
+	dumpLoopTiming(LOOP_LANE, "driveLane");
+	dumpI2CLatency(mplexer);
+	showResult(elapsed);
 	endChime();
 }
\ No newline at end of file
@@ -0,0 +1,396 @@
+/*
+Coverage and occupancy map
+Description: A grid of MAP_CELL cm cells over the pose frame (UW_pose.c), four bits to a cell so the
+whole map fits in the EV3's memory. A cell is unknown, seen free, swept by the drum (holding how many
+times the drum has passed over it, up to MAP_MOST_VISITS) or an obstacle.
+
+A high priority task updates the map every MAP_PERIOD ms from the latest pose and sensor snapshot:
+while the drum spins, every cell whose centre is under the drum is swept, and counts a visit when it
+first comes under it; the ultrasonic beam marks the cells it crosses as seen free and the cell it
+returns from as an obstacle. Control code adds what only it can tell, such as which bumper hit, with
+chartObstacle().
+
+Coverage is the share of the cells known to be free that have been swept. Cells are only known once
+the robot has swept them or ranged across them, so the figure is of the floor found so far. Room
+coverage is the share of the room's outline that has been swept, the outline being every row of the map
+from its first swept cell to its last; once the edges have been followed the swept ring around them
+makes that the room's floor, where the floor found so far is little more than the ring. The columns
+give a second outline, and the larger is taken, so a gap in one side of the ring does not shrink it.
+countUnswept() looks along a ray for floor still to sweep, to steer towards it.
+*/
+
+#ifndef __UW_COVERAGEMAP_C__
+#define __UW_COVERAGEMAP_C__
+
+#include <UW_pose.c>
+
+#define MAP_CELL 5			// cm
+#define MAP_COLS 192		// cells along x, 9.6 m
+#define MAP_ROWS 192		// cells along y
+#define MAP_PERIOD 20		// ms between map updates
+#define MAP_RANGE 150		// cm, further ultrasonic ranges are not charted
+
+// cell values
+#define MAP_UNKNOWN 0
+#define MAP_FREE 1			// seen free, not swept yet
+#define MAP_OBSTACLE 15
+#define MAP_MOST_VISITS 13	// swept cells hold MAP_FREE + visits
+
+ubyte mapCells[MAP_COLS * MAP_ROWS / 2];
+float mapOriginX;			// pose frame position of the corner of cell (0, 0)
+float mapOriginY;
+long mapKnownCells = 0;		// seen free or swept
+long mapSweptCells = 0;
+short mapRowFirst[MAP_ROWS];	// column of the first swept cell of each row, MAP_COLS if none
+short mapRowLast[MAP_ROWS];		// of the last, -1 if none
+short mapColFirst[MAP_COLS];	// row of the first swept cell of each column, MAP_ROWS if none
+short mapColLast[MAP_COLS];
+long mapRowOutline = 0;			// cells from the first swept cell to the last of every row
+long mapColOutline = 0;			// of every column
+
+tMotor mapDrum;
+float mapDrumWidth;
+float mapDrumDepth;
+float mapSensorOffset;
+
+/**
+ * @brief Whether a cell value is floor, seen or swept
+ */
+bool isFloor(int value)
+{
+	return value != MAP_UNKNOWN && value != MAP_OBSTACLE;
+}
+
+/**
+ * @brief Whether a cell value is floor the drum has swept
+ */
+bool isSwept(int value)
+{
+	return value > MAP_FREE && value != MAP_OBSTACLE;
+}
+
+/**
+ * @brief Value of a cell
+ *
+ * @param col column, along x
+ * @param row row, along y
+ * @return MAP_UNKNOWN, MAP_FREE, MAP_FREE + visits or MAP_OBSTACLE; cells off the map are obstacles
+ */
+int getMapCell(int col, int row)
+{
+	if (col < 0 || col >= MAP_COLS || row < 0 || row >= MAP_ROWS)
+		return MAP_OBSTACLE;
+
+	long index = (long)row * MAP_COLS + col;
+	if ((index & 1) == 0)
+		return mapCells[index / 2] & 0x0F;
+	return mapCells[index / 2] >> 4;
+}
+
+/**
+ * @brief Widen a row's or column's span of swept cells to take in another
+ *
+ * @param first start of the span, past the end of the map if empty
+ * @param last end of the span, -1 if empty
+ * @param at the swept cell
+ * @return cells the span grew by
+ */
+int widenSpan(short &first, short &last, int at)
+{
+	if (at >= first && at <= last)
+		return 0;
+
+	int old = last >= 0 ? last - first + 1 : 0;
+	if (at < first)
+		first = at;
+	if (at > last)
+		last = at;
+	return last - first + 1 - old;
+}
+
+/**
+ * @brief Change a cell, keeping the coverage counts
+ *
+ * @param col column, on the map
+ * @param row row, on the map
+ * @param value new value
+ */
+void setMapCell(int col, int row, int value)
+{
+	int old = getMapCell(col, row);
+	if (isFloor(value) != isFloor(old))
+		mapKnownCells += isFloor(value) ? 1 : -1;
+	if (isSwept(value) != isSwept(old))
+		mapSweptCells += isSwept(value) ? 1 : -1;
+	if (isSwept(value))
+	{
+		mapRowOutline += widenSpan(mapRowFirst[row], mapRowLast[row], col);
+		mapColOutline += widenSpan(mapColFirst[col], mapColLast[col], row);
+	}
+
+	long index = (long)row * MAP_COLS + col;
+	if ((index & 1) == 0)
+		mapCells[index / 2] = (mapCells[index / 2] & 0xF0) | value;
+	else
+		mapCells[index / 2] = (mapCells[index / 2] & 0x0F) | (value << 4);
+}
+
+/**
+ * @brief Cell holding a position
+ *
+ * @param x cm, pose frame
+ * @param y cm
+ * @param col set to the column
+ * @param row set to the row
+ * @return false if the position is off the map
+ */
+bool mapCellAt(float x, float y, int &col, int &row)
+{
+	col = (int)floor((x - mapOriginX) / MAP_CELL);
+	row = (int)floor((y - mapOriginY) / MAP_CELL);
+	return col >= 0 && col < MAP_COLS && row >= 0 && row < MAP_ROWS;
+}
+
+/**
+ * @brief Times the drum has passed over a position
+ *
+ * @param x cm, pose frame
+ * @param y cm
+ * @return visits, 0 if the cell has not been swept or is off the map
+ */
+int getVisits(float x, float y)
+{
+	int col, row;
+	if (!mapCellAt(x, y, col, row))
+		return 0;
+	int value = getMapCell(col, row);
+	return isSwept(value) ? value - MAP_FREE : 0;
+}
+
+/**
+ * @brief Share of the floor found so far that has been swept
+ *
+ * @return percent
+ */
+float getCoverage()
+{
+	return mapKnownCells > 0 ? 100.0 * mapSweptCells / mapKnownCells : 0;
+}
+
+/**
+ * @brief Share of the room's outline that has been swept
+ *
+ * Obstacles inside the outline count as floor, so this is low by their area.
+ * @return percent
+ */
+float getRoomCoverage()
+{
+	long outline = mapRowOutline > mapColOutline ? mapRowOutline : mapColOutline;
+	return outline > 0 ? 100.0 * mapSweptCells / outline : 0;
+}
+
+/**
+ * @brief Cells along a ray from a position that the drum has not swept yet, up to the first obstacle
+ *
+ * Unknown cells count, as they are floor the robot has not found yet unless an obstacle comes first.
+ * @param x cm, pose frame
+ * @param y cm
+ * @param heading degrees counter-clockwise
+ * @param range cm to look along the ray
+ * @return cells
+ */
+int countUnswept(float x, float y, float heading, float range)
+{
+	float h = heading * PI / 180;
+	float dx = cos(h);
+	float dy = sin(h);
+	int lastCol = -1;
+	int lastRow = -1;
+	int count = 0;
+
+	for (float along = 0; along < range; along += MAP_CELL / 2.0)
+	{
+		int col, row;
+		if (!mapCellAt(x + along * dx, y + along * dy, col, row))
+			break;
+		if (col == lastCol && row == lastRow)
+			continue;
+		lastCol = col;
+		lastRow = row;
+
+		int value = getMapCell(col, row);
+		if (value == MAP_OBSTACLE)
+			break;
+		if (!isSwept(value))
+			count++;
+	}
+	return count;
+}
+
+/**
+ * @brief Mark an obstacle at a position
+ *
+ * A swept cell stays swept, as the robot has been there.
+ * @param x cm, pose frame
+ * @param y cm
+ */
+void markObstacle(float x, float y)
+{
+	int col, row;
+	if (!mapCellAt(x, y, col, row))
+		return;
+	int value = getMapCell(col, row);
+	if (value == MAP_UNKNOWN || value == MAP_FREE)
+		setMapCell(col, row, MAP_OBSTACLE);
+}
+
+/**
+ * @brief Mark an obstacle at a point on the robot, e.g. where a bumper touched
+ *
+ * @param pose the pose the robot touched it at
+ * @param ahead cm ahead of the robot's centre
+ * @param left cm to the left
+ */
+void chartObstacle(tPose &pose, float ahead, float left)
+{
+	float h = pose.heading * PI / 180;
+	markObstacle(pose.x + ahead * cos(h) - left * sin(h), pose.y + ahead * sin(h) + left * cos(h));
+}
+
+/**
+ * @brief Mark the cells the ultrasonic beam crossed as seen free, and the one it returned from
+ *
+ * @param pose where the robot is
+ * @param range the reading, cm
+ */
+void chartRange(tPose &pose, int range)
+{
+	// the sensor faces right
+	float h = pose.heading * PI / 180;
+	float rightX = sin(h);
+	float rightY = -cos(h);
+	float x = pose.x + mapSensorOffset * rightX;
+	float y = pose.y + mapSensorOffset * rightY;
+	int col, row;
+
+	float clear = range < MAP_RANGE ? range - MAP_CELL : MAP_RANGE;
+	for (float along = 0; along < clear; along += MAP_CELL / 2.0)
+	{
+		if (mapCellAt(x + along * rightX, y + along * rightY, col, row) && getMapCell(col, row) == MAP_UNKNOWN)
+			setMapCell(col, row, MAP_FREE);
+	}
+	if (range < MAP_RANGE)
+		markObstacle(x + range * rightX, y + range * rightY);
+}
+
+/**
+ * @brief Sweep the cells under the drum, counting a visit to those that were not under it last time
+ *
+ * @param pose where the robot is
+ * @param last where it was at the last sweep
+ * @param swept false if the drum did not sweep last time
+ */
+void sweepDrum(tPose &pose, tPose &last, bool swept)
+{
+	float h = pose.heading * PI / 180;
+	float fx = cos(h);
+	float fy = sin(h);
+	float lastH = last.heading * PI / 180;
+	float lastFx = cos(lastH);
+	float lastFy = sin(lastH);
+	float halfWidth = mapDrumWidth / 2;
+	float halfDepth = mapDrumDepth / 2;
+	float reach = sqrt(halfWidth * halfWidth + halfDepth * halfDepth);
+	int col0, row0, col1, row1;
+
+	mapCellAt(pose.x - reach, pose.y - reach, col0, row0);
+	mapCellAt(pose.x + reach, pose.y + reach, col1, row1);
+	for (int row = row0 < 0 ? 0 : row0; row <= row1 && row < MAP_ROWS; row++)
+	{
+		for (int col = col0 < 0 ? 0 : col0; col <= col1 && col < MAP_COLS; col++)
+		{
+			float cx = mapOriginX + (col + 0.5) * MAP_CELL;
+			float cy = mapOriginY + (row + 0.5) * MAP_CELL;
+			float dx = cx - pose.x;
+			float dy = cy - pose.y;
+			if (abs(dx * fx + dy * fy) > halfDepth || abs(dy * fx - dx * fy) > halfWidth)
+				continue;
+
+			int value = getMapCell(col, row);
+			if (!isSwept(value))
+			{
+				setMapCell(col, row, MAP_FREE + 1);
+				continue;
+			}
+			dx = cx - last.x;
+			dy = cy - last.y;
+			bool wasUnder = swept && abs(dx * lastFx + dy * lastFy) <= halfDepth &&
+				abs(dy * lastFx - dx * lastFy) <= halfWidth;
+			if (!wasUnder && value < MAP_FREE + MAP_MOST_VISITS)
+				setMapCell(col, row, value + 1);
+		}
+	}
+}
+
+task mapTask()
+{
+	tPose pose;
+	tPose last;
+	tSensorSnapshot sensors;
+	bool swept = false;
+
+	while (true)
+	{
+		getPose(pose);
+		getSensorSnapshot(sensors);
+
+		chartRange(pose, sensors.distance);
+		if (motor[mapDrum] != 0)
+		{
+			sweepDrum(pose, last, swept);
+			memcpy(&last, &pose, sizeof(tPose));
+		}
+		swept = motor[mapDrum] != 0;
+		sleep(MAP_PERIOD);
+	}
+}
+
+/**
+ * @brief Start mapping, with an empty map
+ *
+ * Call once the pose task is running. The map reaches a third of its width behind and to the right of
+ * where the robot starts and two thirds ahead and to the left, as the room lies on the left of a robot
+ * started along its edge.
+ * @param drum drum motor, the drum sweeps while it turns
+ * @param drumWidth cm swept across the robot, centred on it
+ * @param drumDepth cm of floor under the drum along the robot
+ * @param sensorOffset cm from the robot's centre to the ultrasonic sensor, facing right
+ */
+void startCoverageMap(tMotor drum, float drumWidth, float drumDepth, float sensorOffset)
+{
+	mapDrum = drum;
+	mapDrumWidth = drumWidth;
+	mapDrumDepth = drumDepth;
+	mapSensorOffset = sensorOffset;
+	mapOriginX = -MAP_COLS * MAP_CELL / 3;
+	mapOriginY = -MAP_ROWS * MAP_CELL / 3;
+	memset(mapCells, 0, sizeof(mapCells));
+	mapKnownCells = 0;
+	mapSweptCells = 0;
+	for (int row = 0; row < MAP_ROWS; row++)
+	{
+		mapRowFirst[row] = MAP_COLS;
+		mapRowLast[row] = -1;
+	}
+	for (int col = 0; col < MAP_COLS; col++)
+	{
+		mapColFirst[col] = MAP_ROWS;
+		mapColLast[col] = -1;
+	}
+	mapRowOutline = 0;
+	mapColOutline = 0;
+
+	startTask(mapTask, kHighPriority);
+}
+
+#endif // __UW_COVERAGEMAP_C__
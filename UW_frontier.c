@@ -0,0 +1,393 @@
+/*
+Frontier planner
+Description: Finds the nearest stretch of floor the drum has not swept on the coverage map
+(UW_coverageMap.c) and a path there, for a robot whose local cleaning has stopped finding new floor.
+
+The map is planned on in blocks of FRONTIER_BLOCK cells, small enough for a grid search to fit in the
+EV3's memory. A block is open if it lies inside the room's outline, as the map has swept it, and holds
+no obstacle; one next to an obstacle costs more to cross, so paths keep clear of walls where they can. A
+frontier is an open block with at least FRONTIER_UNCOVERED cells of floor still to sweep, seen free or
+not yet seen, beside a block the drum has swept: the boundary between covered and uncovered floor.
+
+planFrontier() takes the frontiers nearest the robot in a straight line and runs A* to each in turn until
+one can be reached, then pulls the path straight between blocks that can see each other, leaving the
+waypoints in frontierPathX and frontierPathY for the control code to drive.
+*/
+
+#ifndef __UW_FRONTIER_C__
+#define __UW_FRONTIER_C__
+
+#include <UW_coverageMap.c>
+
+#define FRONTIER_BLOCK 4			// map cells to a side of a planning block, 20 cm
+#define FRONTIER_COLS (MAP_COLS / FRONTIER_BLOCK)
+#define FRONTIER_ROWS (MAP_ROWS / FRONTIER_BLOCK)
+#define FRONTIER_BLOCKS (FRONTIER_COLS * FRONTIER_ROWS)
+#define FRONTIER_UNCOVERED 12		// cells of unswept floor that make a block worth going to
+#define FRONTIER_TRIES 3			// frontiers tried, nearest first, before giving up
+#define FRONTIER_NEAR_COST 20		// extra cost of a block next to an obstacle, a straight step costs 10
+#define FRONTIER_PATH 128			// blocks of a path kept, from the robot
+#define FRONTIER_WAYPOINTS 16
+
+// block flags
+#define BLOCK_OPEN 1		// inside the outline, no obstacle
+#define BLOCK_SWEPT 2		// some of it swept
+#define BLOCK_UNCOVERED 4	// FRONTIER_UNCOVERED cells or more still to sweep
+#define BLOCK_NEAR 8		// next to a block with an obstacle
+#define BLOCK_TRIED 16		// a frontier no path was found to
+#define BLOCK_OBSTACLE 32	// holds an obstacle
+
+// blockFrom holds the step into a block, and whether the search is done with it
+#define FROM_NONE 8
+#define FROM_STEP 0x0F
+#define FROM_CLOSED 0x10
+
+#define FRONTIER_NO_COST 32767
+
+ubyte blockFlags[FRONTIER_BLOCKS];
+short blockCost[FRONTIER_BLOCKS];	// cost of the best path found so far from the robot
+ubyte blockFrom[FRONTIER_BLOCKS];
+short openHeap[FRONTIER_BLOCKS];	// blocks to search from, cheapest estimate first
+short openEstimate[FRONTIER_BLOCKS];	// the estimate each was added with, a block may be in more than once
+int openCount;
+short frontierBlocks[FRONTIER_PATH];
+
+float frontierPathX[FRONTIER_WAYPOINTS];	// pose frame, cm
+float frontierPathY[FRONTIER_WAYPOINTS];
+int frontierWaypoints = 0;
+
+// the eight steps between blocks, straight ones even
+const int stepCol[8] = {1, 1, 0, -1, -1, -1, 0, 1};
+const int stepRow[8] = {0, 1, 1, 1, 0, -1, -1, -1};
+
+/**
+ * @brief Whether a cell lies inside the room's outline, between the first and last swept cells of both
+ * its row and its column
+ */
+bool insideOutline(int col, int row)
+{
+	return col >= mapRowFirst[row] && col <= mapRowLast[row] &&
+		row >= mapColFirst[col] && row <= mapColLast[col];
+}
+
+/**
+ * @brief Flag every block from the map
+ */
+void classifyBlocks()
+{
+	for (int blockRow = 0; blockRow < FRONTIER_ROWS; blockRow++)
+	{
+		for (int blockCol = 0; blockCol < FRONTIER_COLS; blockCol++)
+		{
+			int obstacles = 0;
+			int swept = 0;
+			int uncovered = 0;
+			for (int row = blockRow * FRONTIER_BLOCK; row < (blockRow + 1) * FRONTIER_BLOCK; row++)
+			{
+				for (int col = blockCol * FRONTIER_BLOCK; col < (blockCol + 1) * FRONTIER_BLOCK; col++)
+				{
+					int value = getMapCell(col, row);
+					if (value == MAP_OBSTACLE)
+						obstacles++;
+					else if (isSwept(value))
+						swept++;
+					else if (value == MAP_FREE || insideOutline(col, row))
+						uncovered++;
+				}
+			}
+
+			int middle = FRONTIER_BLOCK / 2;
+			ubyte flags = 0;
+			if (obstacles == 0 &&
+				insideOutline(blockCol * FRONTIER_BLOCK + middle, blockRow * FRONTIER_BLOCK + middle))
+				flags |= BLOCK_OPEN;
+			if (swept > 0)
+				flags |= BLOCK_SWEPT;
+			if (uncovered >= FRONTIER_UNCOVERED)
+				flags |= BLOCK_UNCOVERED;
+			if (obstacles > 0)
+				flags |= BLOCK_OBSTACLE | BLOCK_NEAR;
+			blockFlags[blockRow * FRONTIER_COLS + blockCol] = flags;
+		}
+	}
+
+	// a block with an obstacle marks its neighbours as near one
+	for (int block = 0; block < FRONTIER_BLOCKS; block++)
+	{
+		if ((blockFlags[block] & BLOCK_OBSTACLE) == 0)
+			continue;
+		int blockCol = block % FRONTIER_COLS;
+		int blockRow = block / FRONTIER_COLS;
+		for (int step = 0; step < 8; step++)
+		{
+			int col = blockCol + stepCol[step];
+			int row = blockRow + stepRow[step];
+			if (col >= 0 && col < FRONTIER_COLS && row >= 0 && row < FRONTIER_ROWS)
+				blockFlags[row * FRONTIER_COLS + col] |= BLOCK_NEAR;
+		}
+	}
+}
+
+/**
+ * @brief Whether an open block with floor to sweep lies beside a swept one
+ */
+bool isFrontier(int block)
+{
+	if ((blockFlags[block] & (BLOCK_OPEN | BLOCK_UNCOVERED | BLOCK_TRIED)) != (BLOCK_OPEN | BLOCK_UNCOVERED))
+		return false;
+
+	int blockCol = block % FRONTIER_COLS;
+	int blockRow = block / FRONTIER_COLS;
+	for (int step = 0; step < 8; step++)
+	{
+		int col = blockCol + stepCol[step];
+		int row = blockRow + stepRow[step];
+		if (col >= 0 && col < FRONTIER_COLS && row >= 0 && row < FRONTIER_ROWS &&
+			(blockFlags[row * FRONTIER_COLS + col] & BLOCK_SWEPT) != 0)
+			return true;
+	}
+	return false;
+}
+
+/**
+ * @brief Cost of the cheapest path between two blocks with nothing in the way, in the units of a step
+ */
+int blockDistance(int from, int to)
+{
+	int cols = abs(from % FRONTIER_COLS - to % FRONTIER_COLS);
+	int rows = abs(from / FRONTIER_COLS - to / FRONTIER_COLS);
+	int diagonal = cols < rows ? cols : rows;
+	return 10 * (cols + rows) - 6 * diagonal;
+}
+
+/**
+ * @brief Add a block to the open heap, dropped if the heap is full
+ *
+ * @param block the block
+ * @param estimate cost of the path to it and on to the goal with nothing in the way
+ */
+void pushOpen(int block, int estimate)
+{
+	if (openCount >= FRONTIER_BLOCKS)
+		return;
+
+	int at = openCount++;
+	while (at > 0)
+	{
+		int parent = (at - 1) / 2;
+		if (openEstimate[parent] <= estimate)
+			break;
+		openHeap[at] = openHeap[parent];
+		openEstimate[at] = openEstimate[parent];
+		at = parent;
+	}
+	openHeap[at] = block;
+	openEstimate[at] = estimate;
+}
+
+/**
+ * @brief Take the block with the cheapest estimate off the open heap
+ */
+int popOpen()
+{
+	int top = openHeap[0];
+	openCount--;
+	int last = openHeap[openCount];
+	int estimate = openEstimate[openCount];
+	int at = 0;
+	while (true)
+	{
+		int child = 2 * at + 1;
+		if (child >= openCount)
+			break;
+		if (child + 1 < openCount && openEstimate[child + 1] < openEstimate[child])
+			child++;
+		if (estimate <= openEstimate[child])
+			break;
+		openHeap[at] = openHeap[child];
+		openEstimate[at] = openEstimate[child];
+		at = child;
+	}
+	if (openCount > 0)
+	{
+		openHeap[at] = last;
+		openEstimate[at] = estimate;
+	}
+	return top;
+}
+
+/**
+ * @brief A* search over the open blocks
+ *
+ * Diagonal steps may not cut the corner of a block that is not open.
+ * @param start the robot's block, searched from even if it is not open
+ * @param goal an open block
+ * @return true if a path was found, which blockFrom then leads back along from the goal
+ */
+bool searchPath(int start, int goal)
+{
+	for (int block = 0; block < FRONTIER_BLOCKS; block++)
+	{
+		blockCost[block] = FRONTIER_NO_COST;
+		blockFrom[block] = FROM_NONE;
+	}
+	openCount = 0;
+	blockCost[start] = 0;
+	pushOpen(start, blockDistance(start, goal));
+
+	while (openCount > 0)
+	{
+		int at = popOpen();
+		if (at == goal)
+			return true;
+		if ((blockFrom[at] & FROM_CLOSED) != 0)
+			continue;
+		blockFrom[at] |= FROM_CLOSED;
+
+		int atCol = at % FRONTIER_COLS;
+		int atRow = at / FRONTIER_COLS;
+		for (int step = 0; step < 8; step++)
+		{
+			int col = atCol + stepCol[step];
+			int row = atRow + stepRow[step];
+			if (col < 0 || col >= FRONTIER_COLS || row < 0 || row >= FRONTIER_ROWS)
+				continue;
+			int next = row * FRONTIER_COLS + col;
+			if ((blockFlags[next] & BLOCK_OPEN) == 0 || (blockFrom[next] & FROM_CLOSED) != 0)
+				continue;
+			if ((step & 1) != 0 && ((blockFlags[atRow * FRONTIER_COLS + col] & BLOCK_OPEN) == 0 ||
+				(blockFlags[row * FRONTIER_COLS + atCol] & BLOCK_OPEN) == 0))
+				continue;
+
+			int cost = blockCost[at] + ((step & 1) != 0 ? 14 : 10);
+			if ((blockFlags[next] & BLOCK_NEAR) != 0)
+				cost += FRONTIER_NEAR_COST;
+			if (cost < blockCost[next])
+			{
+				blockCost[next] = cost;
+				blockFrom[next] = step;
+				pushOpen(next, cost + blockDistance(next, goal));
+			}
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief Pose frame position of the centre of a block
+ */
+void blockCentre(int block, float &x, float &y)
+{
+	x = mapOriginX + ((block % FRONTIER_COLS) + 0.5) * FRONTIER_BLOCK * MAP_CELL;
+	y = mapOriginY + ((block / FRONTIER_COLS) + 0.5) * FRONTIER_BLOCK * MAP_CELL;
+}
+
+/**
+ * @brief Whether a straight drive between two block centres crosses only open blocks clear of obstacles
+ */
+bool blocksInSight(int from, int to)
+{
+	float fromX, fromY, toX, toY;
+	blockCentre(from, fromX, fromY);
+	blockCentre(to, toX, toY);
+	float length = sqrt((toX - fromX) * (toX - fromX) + (toY - fromY) * (toY - fromY));
+	float step = FRONTIER_BLOCK * MAP_CELL / 4.0;
+
+	for (float along = 0; along < length; along += step)
+	{
+		int col, row;
+		if (!mapCellAt(fromX + (toX - fromX) * along / length, fromY + (toY - fromY) * along / length, col, row))
+			return false;
+		ubyte flags = blockFlags[(row / FRONTIER_BLOCK) * FRONTIER_COLS + col / FRONTIER_BLOCK];
+		if ((flags & BLOCK_OPEN) == 0 || (flags & BLOCK_NEAR) != 0)
+			return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Turn the path searchPath() found into waypoints
+ *
+ * Keeps the first FRONTIER_PATH blocks from the robot, then drops every block the path can go straight
+ * past.
+ */
+void pullPath(int start, int goal)
+{
+	// the path leads back from the goal, so count it first to keep the end near the robot
+	int length = 0;
+	for (int at = goal; at != start; at -= stepRow[blockFrom[at] & FROM_STEP] * FRONTIER_COLS +
+		stepCol[blockFrom[at] & FROM_STEP])
+		length++;
+
+	int index = length;
+	for (int at = goal; at != start; at -= stepRow[blockFrom[at] & FROM_STEP] * FRONTIER_COLS +
+		stepCol[blockFrom[at] & FROM_STEP])
+	{
+		index--;
+		if (index < FRONTIER_PATH)
+			frontierBlocks[index] = at;
+	}
+	if (length > FRONTIER_PATH)
+		length = FRONTIER_PATH;
+
+	frontierWaypoints = 0;
+	int from = start;
+	int next = 0;
+	while (next < length && frontierWaypoints < FRONTIER_WAYPOINTS)
+	{
+		// go as far along the path as can be seen, always at least one block
+		int far = next;
+		while (far + 1 < length && blocksInSight(from, frontierBlocks[far + 1]))
+			far++;
+		from = frontierBlocks[far];
+		blockCentre(from, frontierPathX[frontierWaypoints], frontierPathY[frontierWaypoints]);
+		frontierWaypoints++;
+		next = far + 1;
+	}
+}
+
+/**
+ * @brief Plan a path to the nearest frontier that can be reached
+ *
+ * Goes over the whole map, so takes a while; call it when the robot has stopped.
+ * @param pose where the robot is
+ * @return true if a path was found, its waypoints in frontierPathX and frontierPathY
+ */
+bool planFrontier(tPose &pose)
+{
+	int col, row;
+	frontierWaypoints = 0;
+	if (!mapCellAt(pose.x, pose.y, col, row))
+		return false;
+	int start = (row / FRONTIER_BLOCK) * FRONTIER_COLS + col / FRONTIER_BLOCK;
+
+	classifyBlocks();
+	for (int tries = 0; tries < FRONTIER_TRIES; tries++)
+	{
+		int goal = -1;
+		int best = 0;
+		for (int block = 0; block < FRONTIER_BLOCKS; block++)
+		{
+			if (block == start || !isFrontier(block))
+				continue;
+			int distance = blockDistance(start, block);
+			if (goal < 0 || distance < best)
+			{
+				goal = block;
+				best = distance;
+			}
+		}
+		if (goal < 0)
+			return false;
+
+		if (searchPath(start, goal))
+		{
+			pullPath(start, goal);
+			return true;
+		}
+		blockFlags[goal] |= BLOCK_TRIED;
+	}
+	return false;
+}
+
+#endif // __UW_FRONTIER_C__
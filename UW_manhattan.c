@@ -0,0 +1,447 @@
+/*
+Manhattan-world pose correction
+Description: Keeps the dead-reckoned pose (UW_pose.c) from drifting by assuming, as the missions do,
+that every wall runs along one of the room's two axes, the axes the robot started on. Two kinds of
+sighting correct the pose:
+
+A wall alongside: while the robot drives straight, the ultrasonic range to the wall on its right is
+fitted against the distance travelled. Over MANHATTAN_SPAN cm the slope of the fit is the angle between
+the robot and the wall, so if the wall is within MANHATTAN_TOLERANCE degrees of an axis the heading is
+set to that axis plus the angle, which undoes any gyro drift. Ranges that do not lie along a line are
+not one wall, and an angle further from the gyro's than it can have drifted since the last fix is the
+robot scraping a wall it points into, so neither is believed. The wall's distance fixes the robot's
+position across it. A robot rubbing along the wall reads next to no range and no angle, but then the
+wall is against the sensor, which still fixes the position.
+
+A wall ahead: when a front bumper hits a wall while the robot faces along an axis, the wall's position
+fixes the robot's position along the axis.
+
+A corner: sweepEdge() follows each edge of the room with the wall on its right, so at the corner that
+ends the edge the robot faces along the wall it followed, and every corner being square, along an axis.
+The heading is set to that axis plus the angle fitted over the last stretch of the wall, so gyro drift
+is undone at every corner of a wall that was followed; after a short edge round the end of a wall the
+robot may face anywhere, and only the wall ahead is used. The range to the wall fixes the position
+across it as along a wall, and at an inside corner the wall ahead fixes it along the axis. Tape is not
+taken for a wall: the robot stops short of it by the colour sensor's offset, not the bumper's, and would
+be kept off it by the wrong distance.
+
+Walls are learned while manhattanLearning is set, which the mission does while it follows the room's
+edges and its pose is still fresh; from then on a sighting of a known wall (within MANHATTAN_MATCH cm)
+pulls the position back onto it, and sightings of anything else are ignored, so slipping wheels cannot
+teach it walls that are not there. A wall is remembered with the side the room is on and the stretch of
+it that was seen, and a sighting only matches a wall seen from the same side along the same stretch.
+The walls learned also bound the room: a robot scraping along a wall on its left never bumps it, and its
+wheels roll it through the wall on dead reckoning, so the position is kept between the walls that close
+the room around it, one seen on either side along the stretch the robot is beside. A room that is not a
+rectangle is not taken for the box around it, and where no pair of walls closes it, as in the mouth of an
+alcove, the position is left alone. Call manhattanSide() every control tick, manhattanAhead() on a
+front bump and manhattanCorner() at each corner of the room's edge.
+*/
+
+#ifndef __UW_MANHATTAN_C__
+#define __UW_MANHATTAN_C__
+
+#include <UW_pose.c>
+
+#define MANHATTAN_WALLS 32
+#define MANHATTAN_TOLERANCE 10	// degrees a wall may be off an axis
+#define MANHATTAN_MATCH 40		// cm between two sightings of the same wall
+#define MANHATTAN_END 20		// cm in from the ends of the stretch of a wall seen that it bounds the room
+#define MANHATTAN_ANGLE 20		// degrees, the most the robot may point off a wall it ranges alongside
+#define MANHATTAN_SPAN 50		// cm of travel along a wall before its angle is trusted
+#define MANHATTAN_CORNER_SPAN 20	// cm of travel along a wall that fit its angle at a corner
+#define MANHATTAN_RANGE 100		// cm, further ultrasonic ranges are not taken for a wall
+#define MANHATTAN_JUMP 5		// cm, a bigger change of range between ticks is a different surface
+#define MANHATTAN_STRAIGHT 3	// degrees of turn that end a fit
+#define MANHATTAN_CLEAR 3		// cm, a closer range is the robot rubbing along the wall
+#define MANHATTAN_SCATTER 1.5	// cm RMS off the fitted line, more is more than one wall
+#define MANHATTAN_DRIFT 2		// degrees a minute the gyro may drift between heading fixes
+
+typedef struct
+{
+	ubyte axis;			// 0 for a wall at constant x, 1 at constant y
+	float coordinate;	// cm
+	sbyte side;			// 1 if the room is at higher coordinates than the wall, -1 if lower
+	float from;			// cm along the wall, the stretch of it seen
+	float to;
+} tWall;
+
+tWall manhattanWalls[MANHATTAN_WALLS];
+int manhattanWallCount = 0;
+bool manhattanEnabled = true;
+bool manhattanLearning = true;	// add walls seen for the first time
+float manhattanFrontOffset;	// cm from the robot's centre to the front bumper
+float manhattanSideOffset;	// cm from the robot's centre to the ultrasonic sensor, facing right
+
+// least squares fit of the side range against the distance travelled
+long sideSamples = 0;
+float sideStartHeading;
+float sideStartDistance;
+float sideLastRange;
+float sideSumS, sideSumR, sideSumSS, sideSumSR, sideSumRR;
+
+bool headingFixed = false;	// the heading has been set from a wall, at headingFixTime
+long headingFixTime;
+
+/**
+ * @brief Nearest of the room's axes to a heading, keeping the heading's turn count
+ *
+ * @param heading degrees counter-clockwise
+ * @return multiple of 90 degrees
+ */
+float nearestAxis(float heading)
+{
+	return round(heading / 90) * 90;
+}
+
+/**
+ * @brief Match a sighting of a wall against the walls seen so far
+ *
+ * A sighting matches a wall on the same axis within MANHATTAN_MATCH cm that has the room on the same side
+ * and was seen along the same stretch, give or take MANHATTAN_MATCH cm. While learning, a match stretches
+ * the wall over the sighting, so the wall followed along an edge grows with the robot.
+ * @param axis 0 for a wall at constant x, 1 at constant y
+ * @param coordinate where the sighting puts the wall
+ * @param side 1 if the robot is at higher coordinates than the wall, -1 if lower
+ * @param from cm along the wall, where the stretch sighted starts
+ * @param to where it ends, no less than from
+ * @param known set to false if the wall is new
+ * @return where the wall was first seen, or coordinate if it is new
+ */
+float sightWall(int axis, float coordinate, int side, float from, float to, bool &known)
+{
+	known = true;
+	for (int i = 0; i < manhattanWallCount; i++)
+	{
+		if (manhattanWalls[i].axis != axis || manhattanWalls[i].side != side ||
+			abs(manhattanWalls[i].coordinate - coordinate) >= MANHATTAN_MATCH ||
+			from > manhattanWalls[i].to + MANHATTAN_MATCH || to < manhattanWalls[i].from - MANHATTAN_MATCH)
+			continue;
+
+		if (manhattanLearning)
+		{
+			if (from < manhattanWalls[i].from)
+				manhattanWalls[i].from = from;
+			if (to > manhattanWalls[i].to)
+				manhattanWalls[i].to = to;
+		}
+		return manhattanWalls[i].coordinate;
+	}
+
+	known = false;
+	if (manhattanLearning && manhattanWallCount < MANHATTAN_WALLS)
+	{
+		manhattanWalls[manhattanWallCount].axis = axis;
+		manhattanWalls[manhattanWallCount].coordinate = coordinate;
+		manhattanWalls[manhattanWallCount].side = side;
+		manhattanWalls[manhattanWallCount].from = from;
+		manhattanWalls[manhattanWallCount].to = to;
+		manhattanWallCount++;
+	}
+	return coordinate;
+}
+
+/**
+ * @brief Move a pose onto a wall at a known distance from the robot's centre
+ *
+ * Once learning is over only a known wall moves the position.
+ * @param pose moved onto the wall
+ * @param direction axis the wall lies in from the robot, degrees counter-clockwise
+ * @param distance cm from the robot's centre to the wall
+ * @param reach cm the robot has driven alongside the wall while sighting it, 0 for a single sighting
+ * @return true if the pose was moved
+ */
+bool snapToWall(tPose &pose, float direction, float distance, float reach)
+{
+	// the unit vector towards the wall is one of (1, 0), (0, 1), (-1, 0), (0, -1)
+	int quarter = ((long)round(direction / 90) % 4 + 4) % 4;
+	float dx = quarter == 0 ? 1 : (quarter == 2 ? -1 : 0);
+	float dy = quarter == 1 ? 1 : (quarter == 3 ? -1 : 0);
+	float wall;
+	bool known;
+
+	// the stretch of wall sighted, from where the robot started driving alongside it to where it is now
+	float along = dx != 0 ? pose.y : pose.x;
+	float start = along - reach * (dx != 0 ? sin(pose.heading * PI / 180) : cos(pose.heading * PI / 180));
+	float from = start < along ? start : along;
+	float to = start < along ? along : start;
+
+	if (dx != 0)
+		wall = sightWall(0, pose.x + dx * distance, -dx, from, to, known) - dx * distance;
+	else
+		wall = sightWall(1, pose.y + dy * distance, -dy, from, to, known) - dy * distance;
+	if (!known && !manhattanLearning)
+		return false;
+
+	if (dx != 0)
+		pose.x = wall;
+	else
+		pose.y = wall;
+	return true;
+}
+
+/**
+ * @brief The walls that close the room on either side of a position
+ *
+ * A wall only counts where it was seen, less end cm at either end, and only from the side the room is
+ * on, so the walls of one arm of an L-shaped room do not bound the other arm and the room is never taken
+ * for the box around it. Of those, the nearest on each side of the position count, allowing the position
+ * to be MANHATTAN_MATCH cm past one, as far as a sighting of it may be off.
+ * @param axis 0 for walls at constant x, 1 at constant y
+ * @param coordinate the position along the axis
+ * @param along the position along the walls, y for walls at constant x
+ * @param end cm in from the ends of the stretch of a wall seen that it counts
+ * @param low set to the wall with the room above it
+ * @param high set to the wall with the room below it
+ * @return false unless a wall was found on both sides
+ */
+bool wallsAround(int axis, float coordinate, float along, float end, float &low, float &high)
+{
+	bool foundLow = false;
+	bool foundHigh = false;
+	for (int i = 0; i < manhattanWallCount; i++)
+	{
+		float wall = manhattanWalls[i].coordinate;
+		if (manhattanWalls[i].axis != axis || along < manhattanWalls[i].from + end ||
+			along > manhattanWalls[i].to - end)
+			continue;
+
+		if (manhattanWalls[i].side > 0 && wall < coordinate + MANHATTAN_MATCH && (!foundLow || wall > low))
+		{
+			low = wall;
+			foundLow = true;
+		}
+		if (manhattanWalls[i].side < 0 && wall > coordinate - MANHATTAN_MATCH && (!foundHigh || wall < high))
+		{
+			high = wall;
+			foundHigh = true;
+		}
+	}
+	return foundLow && foundHigh && low < high;
+}
+
+/**
+ * @brief Keep one coordinate of the position inside the walls that close the room around it
+ *
+ * @param axis 0 for x, 1 for y
+ * @param coordinate the position along the axis
+ * @param along the position along the other axis
+ * @return the position, moved inside if it was past a wall
+ */
+float insideWalls(int axis, float coordinate, float along)
+{
+	float low, high;
+	if (!wallsAround(axis, coordinate, along, MANHATTAN_END, low, high))
+		return coordinate;
+
+	// the robot's centre stays a body's radius off the walls
+	low += manhattanFrontOffset;
+	high -= manhattanFrontOffset;
+	if (low >= high)
+		return coordinate;
+	if (coordinate < low)
+		return low;
+	if (coordinate > high)
+		return high;
+	return coordinate;
+}
+
+/**
+ * @brief Whether a heading from a wall can be believed over the gyro's, noting the fix if it can
+ *
+ * The gyro drifts slowly. A fit further from it than it can have drifted since the last fix, give or
+ * take a minute's drift for the fit itself, is the robot scraping a wall it points into, whose direction
+ * it moves along but does not face, and not drift.
+ * @param pose the latest pose
+ * @param heading the heading the wall gives
+ * @return true if the heading may be set
+ */
+bool headingDrifted(tPose &pose, float heading)
+{
+	if (headingFixed &&
+		abs(heading - pose.heading) > MANHATTAN_DRIFT * (1 + (pose.timestamp - headingFixTime) / 60000.0))
+		return false;
+	headingFixed = true;
+	headingFixTime = pose.timestamp;
+	return true;
+}
+
+/**
+ * @brief The angle to the wall on the right and the range to it now, from the fit so far
+ *
+ * Ranges that stray from a line by more than MANHATTAN_SCATTER are not one straight wall: the beam has
+ * swept round a corner onto the next wall, or across furniture, without a jump in range.
+ * @param pose the latest pose
+ * @param angle degrees counter-clockwise from the wall to the robot
+ * @param range fitted range where the robot is now, cm along the sensor's beam
+ * @return true if the ranges fit a straight wall
+ */
+bool fitSide(tPose &pose, float &angle, float &range)
+{
+	// moving away from the wall on the right means the robot points left of it
+	long n = sideSamples;
+	float s = pose.distance - sideStartDistance;
+	float ss = sideSumSS - sideSumS * sideSumS / n;
+	float sr = sideSumSR - sideSumS * sideSumR / n;
+	float slope = sr / ss;
+	angle = atan(slope) * 180 / PI;
+	range = (sideSumR + slope * (s * n - sideSumS)) / n;
+	float squares = sideSumRR - sideSumR * sideSumR / n - slope * sr;
+	return squares <= MANHATTAN_SCATTER * MANHATTAN_SCATTER * n;
+}
+
+/**
+ * @brief Fit the range to the wall on the right, and correct the pose from it once it is long enough
+ *
+ * Call every control tick; a turn, a range outside MANHATTAN_CLEAR to MANHATTAN_RANGE or a jump in range
+ * starts a new fit. A range under MANHATTAN_CLEAR puts the wall against the sensor at once, and once
+ * learning is over the position is also kept inside the walls.
+ * @param sensors the latest snapshot
+ * @param pose the latest pose, moved with any correction
+ */
+void manhattanSide(tSensorSnapshot &sensors, tPose &pose)
+{
+	if (!manhattanEnabled)
+		return;
+
+	if (!manhattanLearning)
+	{
+		float x = insideWalls(0, pose.x, pose.y);
+		float y = insideWalls(1, pose.y, pose.x);
+		if (x != pose.x || y != pose.y)
+		{
+			pose.x = x;
+			pose.y = y;
+			setPosition(x, y);
+		}
+	}
+
+	// rubbing along a wall the robot faces a little into, it reads no angle but the wall is right there
+	float range = sensors.distance;
+	if (range < MANHATTAN_CLEAR)
+	{
+		float along = nearestAxis(pose.heading);
+		sideSamples = 0;
+		if (abs(pose.heading - along) <= MANHATTAN_ANGLE && snapToWall(pose, along - 90, range + manhattanSideOffset, 0))
+			setPosition(pose.x, pose.y);
+		return;
+	}
+	if (range > MANHATTAN_RANGE || (sideSamples > 0 && (abs(range - sideLastRange) > MANHATTAN_JUMP ||
+		abs(pose.heading - sideStartHeading) > MANHATTAN_STRAIGHT)))
+		sideSamples = 0;
+	if (range > MANHATTAN_RANGE)
+		return;
+
+	if (sideSamples == 0)
+	{
+		sideStartHeading = pose.heading;
+		sideStartDistance = pose.distance;
+		sideSumS = sideSumR = sideSumSS = sideSumSR = sideSumRR = 0;
+	}
+	float s = pose.distance - sideStartDistance;
+	sideSamples++;
+	sideSumS += s;
+	sideSumR += range;
+	sideSumSS += s * s;
+	sideSumSR += s * range;
+	sideSumRR += range * range;
+	sideLastRange = range;
+	if (abs(s) < MANHATTAN_SPAN)
+		return;
+
+	float angle, fitted;
+	bool straight = fitSide(pose, angle, fitted);
+	float axis = nearestAxis(pose.heading - angle);
+	sideSamples = 0;
+	if (!straight || abs(angle) > MANHATTAN_ANGLE || abs(pose.heading - angle - axis) > MANHATTAN_TOLERANCE ||
+		!headingDrifted(pose, axis + angle))
+		return;
+
+	snapToWall(pose, axis - 90, (fitted + manhattanSideOffset) * cos(angle * PI / 180), s);
+	setPose(pose.x, pose.y, axis + angle);
+}
+
+/**
+ * @brief Correct the pose from a wall the front bumper has hit
+ *
+ * Does nothing unless the robot faces within MANHATTAN_TOLERANCE degrees of an axis.
+ * @param pose the latest pose, moved with any correction
+ */
+void manhattanAhead(tPose &pose)
+{
+	if (!manhattanEnabled)
+		return;
+
+	float axis = nearestAxis(pose.heading);
+	if (abs(pose.heading - axis) <= MANHATTAN_TOLERANCE && snapToWall(pose, axis, manhattanFrontOffset, 0))
+		setPosition(pose.x, pose.y);
+	sideSamples = 0;
+}
+
+/**
+ * @brief Correct the pose at a corner of the room's edge
+ *
+ * Call when sweepEdge() finds the corner, before manhattanAhead() or manhattanSide() see that tick, while
+ * the fit of the wall that led to it is still there. Does nothing unless the robot faces within
+ * MANHATTAN_TOLERANCE degrees of an axis.
+ * @param pose the latest pose, moved with the correction
+ * @param ahead cm from the robot's centre to the wall it has hit ahead at an inside corner, negative at
+ * any other
+ */
+void manhattanCorner(tPose &pose, float ahead)
+{
+	if (!manhattanEnabled)
+		return;
+
+	// the heading needs the wall followed into the corner fitted: short edges around the end of a wall,
+	// with nothing on the right, leave the robot at any angle, and rubbing along the wall it may be
+	// pointing into it
+	float angle = 0;
+	float range = -1;
+	bool alongWall = false;
+	if (sideSamples > 1 && abs(pose.distance - sideStartDistance) >= MANHATTAN_CORNER_SPAN)
+		alongWall = fitSide(pose, angle, range);
+	if (!alongWall)
+	{
+		angle = 0;
+		range = -1;
+	}
+	float axis = nearestAxis(pose.heading - angle);
+	sideSamples = 0;
+	if (abs(angle) > MANHATTAN_ANGLE || abs(pose.heading - angle - axis) > MANHATTAN_TOLERANCE)
+		return;
+	if (!alongWall || !headingDrifted(pose, axis + angle))
+	{
+		// a wall ahead still fixes the position, as for any bump
+		if (ahead >= 0 && snapToWall(pose, axis, ahead, 0))
+			setPosition(pose.x, pose.y);
+		return;
+	}
+
+	if (range >= 0)
+		snapToWall(pose, axis - 90, (range + manhattanSideOffset) * cos(angle * PI / 180),
+			pose.distance - sideStartDistance);
+	if (ahead >= 0)
+		snapToWall(pose, axis, ahead, 0);
+	pose.heading = axis + angle;
+	setPose(pose.x, pose.y, pose.heading);
+}
+
+/**
+ * @brief Start correcting
+ *
+ * Call once the pose task is running, with the robot facing along one of the room's axes.
+ * @param front cm from the robot's centre to the front bumper
+ * @param side cm from the robot's centre to the ultrasonic sensor
+ */
+void startManhattan(float front, float side)
+{
+	manhattanFrontOffset = front;
+	manhattanSideOffset = side;
+	manhattanWallCount = 0;
+	manhattanLearning = true;
+	sideSamples = 0;
+	headingFixed = false;
+}
+
+#endif // __UW_MANHATTAN_C__
@@ -0,0 +1,173 @@
+/*
+Dead-reckoning pose estimator
+Description: A high priority task works out where the robot is every POSE_PERIOD ms from the two drive
+encoders and the gyro: the encoders give the distance each wheel has rolled, the gyro the heading, and
+each step is taken along the heading halfway through it. Nothing is ever reset, so the pose is in one
+frame for the whole mission: x along the way the robot faced when the task started, y to its left and
+the heading counter-clockwise in degrees, unwrapped. Control code must leave the drive encoders alone
+once the task runs and measure moves from the change in encoder counts.
+
+The gyro heading comes from the sensor task's snapshots (UW_sensorTask.c), which must be running first;
+the encoders are read through UW_recorder.c so a replay gets them too. Poses are double buffered and
+counted like the snapshots, so getPose() is a copy that never waits and never returns half of one update
+and half of the next. setPose() moves the estimate onto a known position, e.g. when a landmark is
+recognised.
+*/
+
+#ifndef __UW_POSE_C__
+#define __UW_POSE_C__
+
+#include <UW_sensorTask.c>
+
+#define POSE_PERIOD 5	// ms between pose updates
+
+typedef struct
+{
+	long timestamp;		// nSysTime of the update
+	float x;			// cm
+	float y;
+	float heading;		// degrees counter-clockwise, unwrapped
+	float distance;		// cm rolled since startPoseTask(), forwards positive
+} tPose;
+
+tPose poseBuffer[2];
+int poseFront = 0;
+long poseWrites = 0;	// counted up before and after every fill of the back buffer, odd while one is under way
+
+tMotor poseLeft;
+tMotor poseRight;
+float poseCmPerDegree;
+
+// heading = poseHeadingOffset - gyro heading; setPose() moves it
+float poseHeadingOffset;
+bool poseMoved = false;
+bool poseTurned = false;	// setPose() rather than setPosition()
+tPose poseMovedTo;
+
+task poseTask()
+{
+	long lastLeft = recordedEncoder(poseLeft);
+	long lastRight = recordedEncoder(poseRight);
+	tSensorSnapshot sensors;
+	getSensorSnapshot(sensors);
+	float lastHeading = poseHeadingOffset - sensors.heading;
+
+	while (true)
+	{
+		int back = 1 - poseFront;
+		poseWrites++;
+		memcpy(&poseBuffer[back], &poseBuffer[poseFront], sizeof(tPose));
+
+		long left = recordedEncoder(poseLeft);
+		long right = recordedEncoder(poseRight);
+		getSensorSnapshot(sensors);
+
+		if (poseMoved)
+		{
+			poseMoved = false;
+			poseBuffer[back].x = poseMovedTo.x;
+			poseBuffer[back].y = poseMovedTo.y;
+			if (poseTurned)
+			{
+				poseTurned = false;
+				poseHeadingOffset = poseMovedTo.heading + sensors.heading;
+				lastHeading = poseMovedTo.heading;
+			}
+		}
+
+		float heading = poseHeadingOffset - sensors.heading;
+		float step = ((left - lastLeft) + (right - lastRight)) / 2.0 * poseCmPerDegree;
+		float middle = (lastHeading + heading) / 2 * PI / 180;
+
+		poseBuffer[back].timestamp = nSysTime;
+		poseBuffer[back].x += step * cos(middle);
+		poseBuffer[back].y += step * sin(middle);
+		poseBuffer[back].heading = heading;
+		poseBuffer[back].distance += step;
+		poseFront = back;
+		poseWrites++;
+
+		lastLeft = left;
+		lastRight = right;
+		lastHeading = heading;
+		sleep(POSE_PERIOD);
+	}
+}
+
+/**
+ * @brief Copy the latest pose
+ *
+ * Never blocks, like getSensorSnapshot(), and retries the same way: the high priority task can update
+ * twice during the copy, leaving poseFront where it was but the buffer rewritten, so the copy is
+ * repeated whenever poseWrites moved on while it was taken.
+ * @param pose filled with the estimate
+ */
+void getPose(tPose &pose)
+{
+	long writes;
+	do
+	{
+		writes = poseWrites;
+		memcpy(&pose, &poseBuffer[poseFront], sizeof(tPose));
+	} while (writes != poseWrites);
+}
+
+/**
+ * @brief Put the estimate at a known position and heading
+ *
+ * Takes effect at the task's next update; the distance rolled is kept.
+ * @param x cm
+ * @param y cm
+ * @param heading degrees counter-clockwise
+ */
+void setPose(float x, float y, float heading)
+{
+	poseMovedTo.x = x;
+	poseMovedTo.y = y;
+	poseMovedTo.heading = heading;
+	poseTurned = true;
+	poseMoved = true;
+}
+
+/**
+ * @brief Put the estimate at a known position, leaving the heading to the gyro
+ *
+ * Takes effect at the task's next update, like setPose().
+ * @param x cm
+ * @param y cm
+ */
+void setPosition(float x, float y)
+{
+	poseMovedTo.x = x;
+	poseMovedTo.y = y;
+	poseMoved = true;
+}
+
+/**
+ * @brief Start estimating, at the origin facing along x
+ *
+ * Call once the sensor task is running.
+ * @param left left drive motor
+ * @param right right drive motor
+ * @param cmPerDegree cm the robot rolls per encoder degree of its wheels, negative if the motors are
+ * mounted so that negative power drives forwards
+ */
+void startPoseTask(tMotor left, tMotor right, float cmPerDegree)
+{
+	poseLeft = left;
+	poseRight = right;
+	poseCmPerDegree = cmPerDegree;
+	poseMoved = false;
+	poseTurned = false;
+	poseWrites = 0;
+	memset(poseBuffer, 0, sizeof(poseBuffer));
+
+	tSensorSnapshot sensors;
+	getSensorSnapshot(sensors);
+	poseHeadingOffset = sensors.heading;
+	poseBuffer[poseFront].timestamp = nSysTime;
+
+	startTask(poseTask, kHighPriority);
+}
+
+#endif // __UW_POSE_C__
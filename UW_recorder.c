@@ -0,0 +1,371 @@
+/*
+Input recorder
+Description: Logs every input the mission reads so a run on the real robot can be fed back to the mission
+in the host simulator (host/bin/<variant> --replay FILE). Inputs are the buttons, the ultrasonic
+distance, the gyro angle and rate, the colour, the SMUX bumpers with their bump counters, the drive
+encoders and rand(). The mission reads them through the recorded...() functions below, and the sensor
+task reports its SMUX reads with recordMuxRead(), so nothing it acts on goes unrecorded.
+
+Each reading is keyed to how many times its input had been read, not to the time it was taken: the
+replay hands the mission the same value at the same read of every input, whenever that read comes. A
+control loop therefore sees the gyro and the encoders move tick by tick as they did on the robot however
+its timing differs on the host, and a run recorded on the host replays to the same motor commands, which
+make -C host test checks. A robot run only replays that closely while the host's timing makes the
+mission read its inputs as often as the robot did; the host keeps its own clock and I2C bus.
+
+Only changes are stored, as 8 byte events. Events are streamed to a file on the brick for as long as the
+mission runs: they are gathered in two blocks of RECORDER_BLOCK events, and a low priority task writes
+each block out once it is full while the other one fills. If both blocks are full because the writer has
+fallen behind, recording stops there and the events lost are counted, so the file is always a complete
+record of the run up to some point.
+
+File layout, little endian: an 8 byte header (the fields of tRecorderHeader in order) followed by the
+events, oldest first, each 4 bytes of read number (1 for an input's first read), 1 byte of source and 3
+bytes of signed value. A last event with source REC_DROPPED holds the number of events lost if recording
+stopped early. If the file cannot be opened the same bytes go to the debug stream instead, the header and
+every event one line each, "REC" followed by the bytes in hex. The replay reads either.
+*/
+
+#ifndef __UW_RECORDER_C__
+#define __UW_RECORDER_C__
+
+#include <UW_telemetry.c>
+
+#ifndef RECORDER_BLOCK
+#define RECORDER_BLOCK 512		// events in each of the two blocks, 4 KB in the file
+#endif
+
+#define RECORDER_WRITE_PERIOD 50	// ms between the writer's checks for a full block
+#define RECORDER_VERSION 3
+#define RECORDER_HEADER_BYTES 8
+#define RECORDER_EVENT_BYTES 8
+
+// event sources
+#define REC_BUTTONS 0		// getButtonPress(buttonUp), the rest follow in TEV3Buttons order to buttonAny
+#define REC_DISTANCE 7		// ultrasonic, cm
+#define REC_HEADING 8		// getGyroDegrees()
+#define REC_RATE 9			// getGyroRate()
+#define REC_COLOUR 10		// SensorValue[] of the colour sensor
+#define REC_TOUCH 11		// SMUX channel 1 pressed, channels 2 and 3 follow
+#define REC_BUMPS 14		// bump counter of SMUX channel 1, channels 2 and 3 follow
+#define REC_ENCODERS 17		// nMotorEncoder[motorA], motorB to motorD follow
+#define REC_RANDOM 21		// rand()
+#define REC_SOURCES 22
+#define REC_DROPPED 255		// not an input: recording stopped here, the value is the events lost
+
+typedef struct
+{
+	ubyte magic[4];		// "UWRC"
+	ubyte version;		// RECORDER_VERSION
+	ubyte eventSize;	// RECORDER_EVENT_BYTES
+	short sources;		// REC_SOURCES
+} tRecorderHeader;
+
+typedef struct
+{
+	long read;			// reads of the source so far, this one included
+	ubyte source;		// REC_ constant
+	long value;			// stored as 24 bits
+} tRecorderEvent;
+
+// the two blocks, one after the other
+tRecorderEvent recording[2 * RECORDER_BLOCK];
+int recordingLength[2];		// events in each block
+bool recordingFull[2];		// block waiting for the writer
+int recordingBlock = 0;		// block being filled
+int recorderWriting = 0;	// block the writer saves next
+long recordingCount = 0;
+long recordingDropped = 0;
+long recorderFile = -1;		// file handle, or negative to write to the debug stream
+bool recorderRunning = false;
+bool recorderStopWriter = false;		// asks the writer to finish
+bool recorderWriterStopped = true;		// the writer has finished, or was never started
+ubyte recorderBytes[RECORDER_BLOCK * RECORDER_EVENT_BYTES];	// a block laid out for the file
+long recorderReads[REC_SOURCES];
+long recorderLast[REC_SOURCES];
+
+tSensors recorderUltrasonic;
+tSensors recorderColour;
+
+/**
+ * @brief Count a read and store it if it differs from the source's last one
+ *
+ * Call with the CPU hogged from the read on, so reads of one input by different tasks are counted in
+ * the order they were made. Does nothing until startRecorder() has been called, or once an event had to
+ * be dropped.
+ * @param source REC_ constant
+ * @param value the reading
+ */
+void recordInput(int source, long value)
+{
+	if (!recorderRunning)
+		return;
+
+	long read = ++recorderReads[source];
+	if (read > 1 && recorderLast[source] == value)
+		return;
+
+	if (recordingDropped == 0 && recordingLength[recordingBlock] == RECORDER_BLOCK)
+	{
+		// the full block is with the writer, carry on in the other once it has been written out
+		if (!recordingFull[1 - recordingBlock])
+		{
+			recordingBlock = 1 - recordingBlock;
+			recordingLength[recordingBlock] = 0;
+		}
+	}
+	if (recordingDropped > 0 || recordingLength[recordingBlock] == RECORDER_BLOCK)
+	{
+		recordingDropped++;
+		return;
+	}
+	recorderLast[source] = value;
+
+	tRecorderEvent *event = &recording[recordingBlock * RECORDER_BLOCK + recordingLength[recordingBlock]];
+	event->read = read;
+	event->source = source;
+	event->value = value;
+	recordingCount++;
+	if (++recordingLength[recordingBlock] == RECORDER_BLOCK)
+		recordingFull[recordingBlock] = true;
+}
+
+/**
+ * @brief getButtonPress(), recorded
+ */
+bool recordedButtonPress(TEV3Buttons button)
+{
+	hogCPU();
+	bool pressed = getButtonPress(button);
+	recordInput(REC_BUTTONS + button - buttonUp, pressed);
+	releaseCPU();
+	return pressed;
+}
+
+/**
+ * @brief SensorValue[] of the ultrasonic or colour port given to startRecorder(), recorded
+ */
+int recordedSensorValue(tSensors port)
+{
+	hogCPU();
+	int value = SensorValue[port];
+	if (port == recorderUltrasonic)
+		recordInput(REC_DISTANCE, value);
+	else if (port == recorderColour)
+		recordInput(REC_COLOUR, value);
+	releaseCPU();
+	return value;
+}
+
+/**
+ * @brief getGyroDegrees(), recorded
+ */
+int recordedGyroDegrees(tSensors port)
+{
+	hogCPU();
+	int degrees = getGyroDegrees(port);
+	recordInput(REC_HEADING, degrees);
+	releaseCPU();
+	return degrees;
+}
+
+/**
+ * @brief getGyroRate(), recorded
+ */
+int recordedGyroRate(tSensors port)
+{
+	hogCPU();
+	int rate = getGyroRate(port);
+	recordInput(REC_RATE, rate);
+	releaseCPU();
+	return rate;
+}
+
+/**
+ * @brief nMotorEncoder[], recorded
+ */
+long recordedEncoder(tMotor motorPort)
+{
+	hogCPU();
+	long degrees = nMotorEncoder[motorPort];
+	recordInput(REC_ENCODERS + motorPort, degrees);
+	releaseCPU();
+	return degrees;
+}
+
+/**
+ * @brief rand(), recorded
+ */
+int recordedRand()
+{
+	hogCPU();
+	int value = rand();
+	recordInput(REC_RANDOM, value);
+	releaseCPU();
+	return value;
+}
+
+/**
+ * @brief Record what a read of an SMUX touch channel returned
+ *
+ * Call once for every channel readAllMuxSensors() read.
+ * @param channel 0 to 2
+ * @param touching the bumper was pressed
+ * @param bumpCount the channel's bump counter
+ */
+void recordMuxRead(int channel, bool touching, int bumpCount)
+{
+	hogCPU();
+	recordInput(REC_TOUCH + channel, touching);
+	recordInput(REC_BUMPS + channel, bumpCount);
+	releaseCPU();
+}
+
+/**
+ * @brief Lay an event out as it is written
+ */
+void packRecorderEvent(tRecorderEvent *event, ubyte *bytes)
+{
+	packTelemetry(&bytes[0], event->read, 4);
+	bytes[4] = event->source;
+	packTelemetry(&bytes[5], event->value, 3);
+}
+
+/**
+ * @brief Write events to the file, or to the debug stream if it could not be opened
+ *
+ * @return false if the file could not be written
+ */
+bool writeRecorderEvents(tRecorderEvent *events, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		packRecorderEvent(&events[i], &recorderBytes[i * RECORDER_EVENT_BYTES]);
+		if (recorderFile < 0)
+			writeHexLine("REC", &recorderBytes[i * RECORDER_EVENT_BYTES], RECORDER_EVENT_BYTES);
+	}
+	return recorderFile < 0 || fileWriteData(recorderFile, &recorderBytes[0], count * RECORDER_EVENT_BYTES);
+}
+
+/**
+ * @brief Write out the block the writer is due to save, if it is ready
+ *
+ * @return false if there was nothing to write
+ */
+bool writeRecorderBlock()
+{
+	int block = recorderWriting;
+	if (!recordingFull[block])
+		return false;
+
+	if (!writeRecorderEvents(&recording[block * RECORDER_BLOCK], recordingLength[block]))
+		writeDebugStreamLine("recorderWriter(): writing the recording failed");
+	recordingFull[block] = false;
+	recorderWriting = 1 - block;
+	return true;
+}
+
+task recorderWriter()
+{
+	// asked to stop rather than stopped, so a block is never left written but still marked full
+	while (!recorderStopWriter)
+	{
+		if (!writeRecorderBlock())
+			sleep(RECORDER_WRITE_PERIOD);
+	}
+	recorderWriterStopped = true;
+}
+
+/**
+ * @brief Open the file and start recording
+ *
+ * Call first thing in task main, once the sensor types have been set and before any input is read.
+ * Goes to the debug stream if the file cannot be opened.
+ * @param fileName file on the brick
+ * @param ultrasonic ultrasonic sensor port
+ * @param colour colour sensor port
+ */
+void startRecorder(const char *fileName, tSensors ultrasonic, tSensors colour)
+{
+	recorderUltrasonic = ultrasonic;
+	recorderColour = colour;
+	for (int i = 0; i < 2; i++)
+	{
+		recordingLength[i] = 0;
+		recordingFull[i] = false;
+	}
+	recordingBlock = 0;
+	recorderWriting = 0;
+	recordingCount = 0;
+	recordingDropped = 0;
+	for (int i = 0; i < REC_SOURCES; i++)
+		recorderReads[i] = 0;
+
+	tRecorderHeader header;
+	header.magic[0] = 'U';
+	header.magic[1] = 'W';
+	header.magic[2] = 'R';
+	header.magic[3] = 'C';
+	header.version = RECORDER_VERSION;
+	header.eventSize = RECORDER_EVENT_BYTES;
+	header.sources = REC_SOURCES;
+
+	ubyte headerBytes[RECORDER_HEADER_BYTES];
+	for (int i = 0; i < 4; i++)
+		headerBytes[i] = header.magic[i];
+	headerBytes[4] = header.version;
+	headerBytes[5] = header.eventSize;
+	packTelemetry(&headerBytes[6], header.sources, 2);
+
+	recorderFile = fileOpenWrite(fileName);
+	if (recorderFile < 0)
+	{
+		writeDebugStreamLine("startRecorder(): cannot open %s, writing to the debug stream", fileName);
+		writeHexLine("REC", &headerBytes[0], RECORDER_HEADER_BYTES);
+	}
+	else if (!fileWriteData(recorderFile, &headerBytes[0], RECORDER_HEADER_BYTES))
+		writeDebugStreamLine("startRecorder(): writing %s failed", fileName);
+
+	recorderRunning = true;
+	recorderStopWriter = false;
+	recorderWriterStopped = false;
+	startTask(recorderWriter, kLowPriority);
+}
+
+/**
+ * @brief Stop recording and write out the events not yet saved
+ *
+ * Waits for the writer to finish the block it is writing, if any, so no block goes into the file twice.
+ * @return true if the file was written
+ */
+bool stopRecorder()
+{
+	recorderRunning = false;
+	recorderStopWriter = true;
+	while (!recorderWriterStopped)
+		sleep(1);
+
+	// the block being filled goes last, after the other one if the writer had not got to it yet
+	if (!recordingFull[recordingBlock] && recordingLength[recordingBlock] < RECORDER_BLOCK)
+		recordingFull[recordingBlock] = recordingLength[recordingBlock] > 0;
+	writeRecorderBlock();
+	writeRecorderBlock();
+
+	if (recordingDropped > 0)
+	{
+		writeDebugStreamLine("stopRecorder(): writer fell behind, %d events dropped", recordingDropped);
+		tRecorderEvent dropped;
+		dropped.read = 0;
+		dropped.source = REC_DROPPED;
+		dropped.value = recordingDropped;
+		writeRecorderEvents(&dropped, 1);
+	}
+
+	if (recorderFile < 0)
+		return false;
+	bool okay = fileClose(recorderFile);
+	recorderFile = -1;
+	return okay;
+}
+
+#endif // __UW_RECORDER_C__
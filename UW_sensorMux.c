@@ -1,3 +1,6 @@
+#ifndef __UW_SENSORMUX_C__
+#define __UW_SENSORMUX_C__
+
 #include "mindsensors-ev3smux.h"
 /*
 This is a wrapper for the mindsensors-ev3smux.h function calls and is based on
@@ -32,6 +35,15 @@ tMSEV3 muxedSensor[3];
 
 tEV3SensorTypeMode typeMode[3];
 
+// Channels that initSensorMux() has set up, the ones readAllMuxSensors() reads
+bool muxConfigured[3];
+
+// Bit of a channel in the snapshot returned by readAllMuxSensors()
+#define MUX_BIT(muxPort) (1 << ((muxPort) % 4))
+
+// Bump counter of each channel when readMuxCollisions() last looked at it
+short muxBumpsSeen[3];
+
 bool initSensorMux(tMUXSensor muxPort, tEV3SensorTypeMode cType)
 {
 	bool okay = true;
@@ -43,15 +55,15 @@ bool initSensorMux(tMUXSensor muxPort, tEV3SensorTypeMode cType)
 		writeDebugStreamLine("initSensor() failed!");
 		okay = false;
 	}
+	muxConfigured[index] = okay;
 	return okay;
 }
 
-int readMuxSensor(tMUXSensor c_muxPort)
+/**
+ * @brief Value of the last reading of a channel, scaled for its mode
+ */
+int muxSensorValue(int index)
 {
-	int index = c_muxPort % 4;
-	if (!readSensor(&muxedSensor[index]))
-		writeDebugStreamLine("readSensor() failed! for %d", index);
-
 	switch(muxedSensor[index].typeMode)
 	{
 	case touchStateBump:
@@ -76,6 +88,112 @@ int readMuxSensor(tMUXSensor c_muxPort)
 
 	case sonarPresence:
 		return (int)muxedSensor[index].presence;
+
+	default:
+		break;
 	}
 	return 0;
 }
+
+int readMuxSensor(tMUXSensor c_muxPort)
+{
+	int index = c_muxPort % 4;
+	if (!readSensor(&muxedSensor[index]))
+		writeDebugStreamLine("readSensor() failed! for %d", index);
+
+	return muxSensorValue(index);
+}
+
+/**
+ * @brief Defines a reader specialised for one sensor mode
+ *
+ * The reader runs the read transaction initSensorMux() built for the channel and unpacks the reply
+ * without looking at the channel's mode, so it must only be used on channels initialised in that mode.
+ * decode sees the channel as sensor and its reply bytes as reply; the reader returns value, the same
+ * number readMuxSensor() gives, which is the last good reading if the transaction fails.
+ */
+#define MUX_READER(name, decode, value) \
+int name(tMUXSensor muxPort) \
+{ \
+	tMSEV3Ptr sensor = &muxedSensor[muxPort % 4]; \
+	ubyte *reply = &sensor->I2CData.reply[0]; \
+	if (transactI2C(&sensor->_read, reply)) \
+	{ \
+		decode; \
+	} \
+	else \
+		writeDebugStreamLine("mux read failed! for %d", muxPort % 4); \
+	return value; \
+}
+
+MUX_READER(readMuxTouch, sensor->touch = reply[0] == 1; sensor->bumpCount = reply[1], (int)sensor->touch)
+MUX_READER(readMuxLight, sensor->light = reply[0] + (reply[1] << 8), (int)sensor->light)
+MUX_READER(readMuxColour, sensor->color = reply[0] + (reply[1] << 8), (int)sensor->color)
+MUX_READER(readMuxGyroAngle, sensor->angle = (short)(reply[0] + (reply[1] << 8)), (int)sensor->angle)
+MUX_READER(readMuxGyroRate, sensor->rate = (short)(reply[0] + (reply[1] << 8)), (int)sensor->rate)
+MUX_READER(readMuxSonar, sensor->distance = reply[0] + (reply[1] << 8), (int)(sensor->distance/10.0))
+MUX_READER(readMuxPresence, sensor->presence = reply[0] == 1, (int)sensor->presence)
+
+/**
+ * @brief Read every configured channel in one pass
+ *
+ * The channels share one port, so their transactions run one after another, but the next request is
+ * sent as soon as the previous reply is in and the previous reading is decoded while the next one is
+ * on the bus. The values are left in muxedSensor[] for muxSensorValue() as well.
+ * @return snapshot with MUX_BIT(channel) set for every channel reading non-zero (pressed, for touch)
+ */
+int readAllMuxSensors()
+{
+	int snapshot = 0;
+	int onBus = -1;	// channel whose request is in flight
+
+	// the extra pass at index 3 collects the last reply
+	for (int index = 0; index <= 3; index++)
+	{
+		if (index < 3 && !muxConfigured[index])
+			continue;
+
+		int previous = onBus;
+		onBus = -1;
+
+		if (previous >= 0 &&
+			!finishI2CTransaction(&muxedSensor[previous]._read, &muxedSensor[previous].I2CData.reply[0]))
+		{
+			writeDebugStreamLine("readAllMuxSensors() failed! for %d", previous);
+			previous = -1;
+		}
+
+		if (index < 3 && startI2CTransaction(&muxedSensor[index]._read))
+			onBus = index;
+
+		if (previous >= 0 && _sensorDecodeReply(&muxedSensor[previous]) && muxSensorValue(previous) != 0)
+			snapshot |= 1 << previous;
+	}
+	return snapshot;
+}
+
+/**
+ * @brief Touch channels pressed since the previous call
+ *
+ * The SMUX counts every press of a touch sensor, so a contact that starts and ends between two polls
+ * still shows up here even though readMuxSensor() never saw the bumper down. Call it once before the
+ * loop that uses it to forget presses that happened earlier.
+ * @return MUX_BIT(channel) set for every channel whose bump counter has moved
+ */
+int readMuxCollisions()
+{
+	int collisions = 0;
+
+	readAllMuxSensors();
+	for (int index = 0; index < 3; index++)
+	{
+		if (!muxConfigured[index] || typeMode[index] != touchStateBump)
+			continue;
+		if (muxedSensor[index].bumpCount != muxBumpsSeen[index])
+			collisions |= 1 << index;
+		muxBumpsSeen[index] = muxedSensor[index].bumpCount;
+	}
+	return collisions;
+}
+
+#endif // __UW_SENSORMUX_C__
@@ -0,0 +1,269 @@
+/*
+Background sensor acquisition
+Description: A high priority task samples the ultrasonic, gyro, colour sensor and every configured SMUX
+channel as fast as the bus allows, resting 1 ms between passes, and publishes each pass as a timestamped
+snapshot. Snapshots are double buffered: the task fills the back buffer and then flips, so control loops
+copy the latest complete pass without ever waiting on the I2C bus. Control loops pace themselves with
+waitForControlTick() and run at CONTROL_PERIOD however slow the bus is; each loop has a timer that
+records the period it actually achieved, for dumpLoopTiming() at the end of the mission.
+
+Defining MUX_PERIOD reads the SMUX only that often to leave the bus idle in between. getCollisions()
+works from the SMUX's bump counters, so a press that starts and ends between two reads is still reported.
+
+Once startTelemetry() has been called the task also records a telemetry sample every period it was
+given, with the bumpers pressed in any pass since the last one (see UW_telemetry.c). It reads its
+inputs through UW_recorder.c, so once startRecorder() has been called every reading is recorded for
+replay on the host.
+
+The task owns the sensors once it is started: control code must not read the SMUX or reset the gyro
+itself, and measures turns from the change in snapshot heading.
+*/
+
+#ifndef __UW_SENSORTASK_C__
+#define __UW_SENSORTASK_C__
+
+#include <UW_sensorMux.c>
+#include <UW_telemetry.c>
+#include <UW_recorder.c>
+
+#define CONTROL_PERIOD 10	// ms between iterations of a control loop
+#define LOOP_TIMERS 8		// control loops that can be timed, see startControlLoop()
+
+#ifndef MUX_PERIOD
+// ms between SMUX reads, 0 to read it every pass; the bump counters keep presses between reads
+#define MUX_PERIOD 0
+#endif
+
+typedef struct
+{
+	long timestamp;		// nSysTime when the pass started; the readings other than touch are at least this recent
+	long sequence;		// passes completed since startSensorTask()
+	int distance;		// ultrasonic, cm
+	float heading;		// gyro degrees, clockwise positive, never reset by the task
+	float rate;			// gyro degrees per second
+	int colour;
+	long touchTime;		// nSysTime when the SMUX read behind touch and bumpCount started
+	int touch;			// readAllMuxSensors() snapshot, MUX_BIT(channel) set while pressed
+	short bumpCount[3];	// SMUX press counter of each channel, wraps at 256
+} tSensorSnapshot;
+
+tSensorSnapshot sensorBuffer[2];
+int sensorFront = 0;	// buffer holding the latest complete pass
+long sensorWrites = 0;	// counted up before and after every fill of the back buffer, odd while one is under way
+
+short bumpsSeen[3];		// bump counters as of the last getCollisions()
+
+// How regularly a control loop really ran, filled in by waitForControlTick()
+typedef struct
+{
+	long iterations;
+	long minPeriod;		// ms between the starts of two iterations
+	long maxPeriod;
+	long totalPeriod;
+	float totalSquares;	// sum of the squared periods, for the jitter
+	long overruns;		// iterations that took longer than CONTROL_PERIOD
+	long started;		// nSysTime the current iteration started
+} tLoopTiming;
+
+tLoopTiming loopTiming[LOOP_TIMERS];
+
+tSensors snapshotUltrasonic;
+tSensors snapshotGyro;
+tSensors snapshotColour;
+
+task sensorTask()
+{
+	long sequence = 0;
+	long touchTime = 0;
+	int touch = 0;
+	int touchSince = 0;	// bumpers pressed in any pass since the last telemetry sample
+	long nextSample = 0;
+
+	while (true)
+	{
+		int back = 1 - sensorFront;
+
+		sensorWrites++;
+		sensorBuffer[back].timestamp = nSysTime;
+		sensorBuffer[back].distance = recordedSensorValue(snapshotUltrasonic);
+		sensorBuffer[back].heading = recordedGyroDegrees(snapshotGyro);
+		sensorBuffer[back].rate = recordedGyroRate(snapshotGyro);
+		sensorBuffer[back].colour = recordedSensorValue(snapshotColour);
+
+		bool muxRead = sequence == 0 || sensorBuffer[back].timestamp - touchTime >= MUX_PERIOD;
+		if (muxRead)
+		{
+			touchTime = sensorBuffer[back].timestamp;
+			touch = readAllMuxSensors();
+			for (int i = 0; i < 3; i++)
+			{
+				if (muxConfigured[i])
+					recordMuxRead(i, (touch & MUX_BIT(i)) != 0, muxedSensor[i].bumpCount);
+			}
+		}
+		sensorBuffer[back].touchTime = touchTime;
+		sensorBuffer[back].touch = touch;
+		for (int i = 0; i < 3; i++)
+			sensorBuffer[back].bumpCount[i] = muxedSensor[i].bumpCount;
+		sensorBuffer[back].sequence = ++sequence;
+
+		sensorFront = back;
+		sensorWrites++;
+
+		// telemetry at its own rate, from the pass just published
+		touchSince |= touch;
+		if (telemetryRunning && sensorBuffer[back].timestamp >= nextSample)
+		{
+			recordTelemetry(sensorBuffer[back].timestamp, recordedEncoder(telemetryLeft),
+				recordedEncoder(telemetryRight), sensorBuffer[back].heading, sensorBuffer[back].distance,
+				sensorBuffer[back].colour, touchSince);
+			touchSince = 0;
+			nextSample += telemetryPeriod;
+			if (nextSample <= sensorBuffer[back].timestamp)
+				nextSample = sensorBuffer[back].timestamp + telemetryPeriod;
+		}
+
+		// a pass without bus waits never yields, so give the control loops a turn between passes
+		sleep(1);
+	}
+}
+
+/**
+ * @brief Copy the latest complete pass
+ *
+ * Never blocks. The front buffer is only written once the task has started another fill, which moves
+ * sensorWrites on, so the copy is repeated whenever the count changed while it was taken. Comparing
+ * sensorFront instead would miss a task that flipped twice during the copy and accept a torn pass. An
+ * odd count alone is no reason to retry: that fill is of the back buffer, and waiting for it to finish
+ * would make the control loops wait on the bus.
+ * @param snapshot filled with the readings
+ */
+void getSensorSnapshot(tSensorSnapshot &snapshot)
+{
+	long writes;
+	do
+	{
+		writes = sensorWrites;
+		memcpy(&snapshot, &sensorBuffer[sensorFront], sizeof(tSensorSnapshot));
+	} while (writes != sensorWrites);
+}
+
+/**
+ * @brief Channels pressed since the previous call
+ *
+ * Edge triggered from the SMUX bump counters, so a bump too short for any pass to see the bumper down
+ * is still reported once, and a bumper held down is reported only when it was first pressed. Use it
+ * alongside snapshot.touch to also catch a bumper that is still pressed.
+ * @param snapshot the latest snapshot
+ * @return MUX_BIT(channel) set for every channel whose bump counter has moved
+ */
+int getCollisions(tSensorSnapshot &snapshot)
+{
+	int collisions = 0;
+	for (int i = 0; i < 3; i++)
+	{
+		if (snapshot.bumpCount[i] != bumpsSeen[i])
+			collisions |= 1 << i;
+		bumpsSeen[i] = snapshot.bumpCount[i];
+	}
+	return collisions;
+}
+
+/**
+ * @brief Start sampling and wait for the first complete pass
+ *
+ * Call after the sensors and SMUX channels have been configured.
+ * @param ultrasonic ultrasonic sensor port
+ * @param gyro gyro sensor port
+ * @param colour colour sensor port
+ */
+void startSensorTask(tSensors ultrasonic, tSensors gyro, tSensors colour)
+{
+	snapshotUltrasonic = ultrasonic;
+	snapshotGyro = gyro;
+	snapshotColour = colour;
+	memset(sensorBuffer, 0, sizeof(sensorBuffer));
+	sensorWrites = 0;
+
+	startTask(sensorTask, kHighPriority);
+	while (sensorBuffer[sensorFront].sequence == 0)
+		sleep(1);
+
+	// presses from before the mission started are not collisions
+	for (int i = 0; i < 3; i++)
+		bumpsSeen[i] = sensorBuffer[sensorFront].bumpCount[i];
+}
+
+/**
+ * @brief Start timing one run of a control loop
+ *
+ * Call in place of setting nextTick to nSysTime before the loop, and again whenever the loop has been
+ * paused (a back-off or a turn inside it), so the pause is not counted as one long iteration.
+ * @param nextTick set to nSysTime
+ * @param loop the loop's timer, 0 to LOOP_TIMERS - 1
+ */
+void startControlLoop(long &nextTick, int loop)
+{
+	nextTick = nSysTime;
+	loopTiming[loop].started = nextTick;
+}
+
+/**
+ * @brief Sleep until the next iteration of a fixed rate control loop is due
+ *
+ * An iteration that overran its period starts the next one straight away instead of trying to catch up.
+ * The period between iteration starts is added to the loop's timer.
+ * @param nextTick nSysTime of the current iteration, set by startControlLoop()
+ * @param loop the loop's timer
+ */
+void waitForControlTick(long &nextTick, int loop)
+{
+	tLoopTiming *timing = &loopTiming[loop];
+
+	nextTick += CONTROL_PERIOD;
+	long remaining = nextTick - nSysTime;
+	if (remaining > 0)
+		sleep(remaining);
+	else
+	{
+		nextTick = nSysTime;
+		timing->overruns++;
+	}
+
+	long now = nSysTime;
+	long period = now - timing->started;
+	timing->started = now;
+
+	if (timing->iterations == 0 || period < timing->minPeriod)
+		timing->minPeriod = period;
+	if (period > timing->maxPeriod)
+		timing->maxPeriod = period;
+	timing->totalPeriod += period;
+	timing->totalSquares += (float)period * period;
+	timing->iterations++;
+}
+
+/**
+ * @brief Write a loop's timing summary to the debug stream
+ *
+ * Jitter is the standard deviation of the period.
+ * @param loop the loop's timer
+ * @param name what to call it
+ */
+void dumpLoopTiming(int loop, const char *name)
+{
+	tLoopTiming *timing = &loopTiming[loop];
+	if (timing->iterations == 0)
+	{
+		writeDebugStreamLine("loop %s: never ran", name);
+		return;
+	}
+
+	float mean = (float)timing->totalPeriod / timing->iterations;
+	float variance = timing->totalSquares / timing->iterations - mean * mean;
+	writeDebugStreamLine("loop %s: %d iterations, period min %d mean %.1f max %d ms, jitter %.1f ms, %d overruns",
+		name, timing->iterations, timing->minPeriod, mean, timing->maxPeriod, sqrt(variance > 0 ? variance : 0),
+		timing->overruns);
+}
+
+#endif // __UW_SENSORTASK_C__
@@ -0,0 +1,221 @@
+/*
+Binary telemetry
+Description: Keeps the last TELEMETRY_SAMPLES samples of the robot's state in a fixed size ring buffer
+in memory: motor powers, two drive encoders, gyro heading, ultrasonic distance, colour, bumpers and
+the mission's state. Recording a sample is a handful of assignments, with no formatting and no I/O, so
+it never disturbs loop timing; the oldest samples are overwritten once the buffer is full.
+
+The buffer holds TELEMETRY_SAMPLES * TELEMETRY_PERIOD ms of the mission, by default 4096 samples every
+250 ms: the last 17 minutes, in 96 KB. That is enough to follow a whole mission but not a single control
+loop; define TELEMETRY_PERIOD as CONTROL_PERIOD (10 ms, the last 41 s) or TELEMETRY_SAMPLES before
+including this file to trade one for the other.
+
+saveTelemetry() writes the buffer out once the mission is over, as a binary file on the brick or,
+if the file cannot be opened, as hex lines on the debug stream. host/bin/teledecode reads either.
+
+File layout, little endian whatever the brick's own layout of the structs: a 16 byte header (the fields
+of tTelemetryHeader in order) followed by the samples, oldest first, each 24 bytes (the fields of
+tTelemetrySample in order). On the debug stream the header and every sample are one line each, "TLM"
+followed by the bytes in hex.
+*/
+
+#ifndef __UW_TELEMETRY_C__
+#define __UW_TELEMETRY_C__
+
+#ifndef TELEMETRY_SAMPLES
+#define TELEMETRY_SAMPLES 4096	// samples kept, 24 bytes each
+#endif
+
+#ifndef TELEMETRY_PERIOD
+#define TELEMETRY_PERIOD 250	// ms between samples
+#endif
+
+#define TELEMETRY_VERSION 1
+#define TELEMETRY_HEADER_BYTES 16
+#define TELEMETRY_SAMPLE_BYTES 24
+
+typedef struct
+{
+	ubyte magic[4];		// "UWTL"
+	ubyte version;		// TELEMETRY_VERSION
+	ubyte sampleSize;	// TELEMETRY_SAMPLE_BYTES
+	short period;		// ms between samples
+	long samples;		// samples that follow
+	long overwritten;	// older samples lost when the buffer wrapped
+} tTelemetryHeader;
+
+typedef struct
+{
+	long time;			// nSysTime, ms
+	long encoderLeft;	// degrees
+	long encoderRight;
+	short heading;		// gyro, tenths of a degree clockwise, 0 to 3599
+	short distance;		// ultrasonic, cm
+	sbyte power[4];		// motor[] of motorA to motorD
+	ubyte colour;
+	ubyte touch;		// MUX_BIT() of every bumper pressed since the previous sample
+	short state;		// telemetryState when the sample was taken
+} tTelemetrySample;
+
+tTelemetrySample telemetry[TELEMETRY_SAMPLES];
+long telemetryCount = 0;	// samples recorded since startTelemetry(), the newest is at (count - 1) % size
+bool telemetryRunning = false;
+short telemetryPeriod;
+tMotor telemetryLeft;
+tMotor telemetryRight;
+
+// What the mission is doing, set by the mission and stored with every sample
+short telemetryState = 0;
+
+/**
+ * @brief Start recording
+ *
+ * @param left motor whose encoder is stored as encoderLeft
+ * @param right motor whose encoder is stored as encoderRight
+ * @param period ms between the samples the caller records, stored in the header, normally TELEMETRY_PERIOD
+ */
+void startTelemetry(tMotor left, tMotor right, short period)
+{
+	telemetryLeft = left;
+	telemetryRight = right;
+	telemetryPeriod = period;
+	telemetryCount = 0;
+	telemetryRunning = true;
+}
+
+/**
+ * @brief Store one sample, overwriting the oldest once the buffer is full
+ *
+ * Does nothing until startTelemetry() has been called.
+ * @param time nSysTime the readings were taken
+ * @param encoderLeft nMotorEncoder[] of the left motor given to startTelemetry()
+ * @param encoderRight the same of the right motor
+ * @param heading gyro degrees, clockwise positive
+ * @param distance ultrasonic, cm
+ * @param colour colour sensor reading
+ * @param touch MUX_BIT() of every bumper pressed since the previous sample
+ */
+void recordTelemetry(long time, long encoderLeft, long encoderRight, float heading, int distance, int colour, int touch)
+{
+	if (!telemetryRunning)
+		return;
+
+	tTelemetrySample *sample = &telemetry[telemetryCount % TELEMETRY_SAMPLES];
+	float wrapped = heading - 360.0 * floor(heading / 360.0);
+
+	sample->time = time;
+	sample->encoderLeft = encoderLeft;
+	sample->encoderRight = encoderRight;
+	sample->heading = (short)(wrapped * 10) % 3600;
+	sample->distance = distance;
+	for (int i = 0; i < 4; i++)
+		sample->power[i] = motor[(tMotor)i];
+	sample->colour = colour;
+	sample->touch = touch;
+	sample->state = telemetryState;
+	telemetryCount++;
+}
+
+/**
+ * @brief Store the low bytes of a value little endian
+ */
+void packTelemetry(ubyte *bytes, long value, int length)
+{
+	for (int i = 0; i < length; i++)
+		bytes[i] = (value >> (8 * i)) & 0xFF;
+}
+
+/**
+ * @brief Lay a header out as it is written
+ */
+void packTelemetryHeader(tTelemetryHeader &header, ubyte *bytes)
+{
+	for (int i = 0; i < 4; i++)
+		bytes[i] = header.magic[i];
+	bytes[4] = header.version;
+	bytes[5] = header.sampleSize;
+	packTelemetry(&bytes[6], header.period, 2);
+	packTelemetry(&bytes[8], header.samples, 4);
+	packTelemetry(&bytes[12], header.overwritten, 4);
+}
+
+/**
+ * @brief Lay a sample out as it is written
+ */
+void packTelemetrySample(tTelemetrySample *sample, ubyte *bytes)
+{
+	packTelemetry(&bytes[0], sample->time, 4);
+	packTelemetry(&bytes[4], sample->encoderLeft, 4);
+	packTelemetry(&bytes[8], sample->encoderRight, 4);
+	packTelemetry(&bytes[12], sample->heading, 2);
+	packTelemetry(&bytes[14], sample->distance, 2);
+	for (int i = 0; i < 4; i++)
+		bytes[16 + i] = (ubyte)sample->power[i];
+	bytes[20] = sample->colour;
+	bytes[21] = sample->touch;
+	packTelemetry(&bytes[22], sample->state, 2);
+}
+
+/**
+ * @brief Write bytes to the debug stream as one line of hex after a tag
+ */
+void writeHexLine(const char *tag, ubyte *bytes, int length)
+{
+	writeDebugStream(tag);
+	for (int i = 0; i < length; i++)
+		writeDebugStream(" %02X", bytes[i]);
+	writeDebugStreamLine("");
+}
+
+/**
+ * @brief Stop recording and write the buffer out
+ *
+ * Goes to the debug stream if the file cannot be opened.
+ * @param fileName file on the brick
+ * @return true if the file was written
+ */
+bool saveTelemetry(const char *fileName)
+{
+	telemetryRunning = false;
+
+	long kept = telemetryCount < TELEMETRY_SAMPLES ? telemetryCount : TELEMETRY_SAMPLES;
+	long first = telemetryCount - kept;
+
+	tTelemetryHeader header;
+	header.magic[0] = 'U';
+	header.magic[1] = 'W';
+	header.magic[2] = 'T';
+	header.magic[3] = 'L';
+	header.version = TELEMETRY_VERSION;
+	header.sampleSize = TELEMETRY_SAMPLE_BYTES;
+	header.period = telemetryPeriod;
+	header.samples = kept;
+	header.overwritten = first;
+
+	ubyte headerBytes[TELEMETRY_HEADER_BYTES];
+	ubyte sampleBytes[TELEMETRY_SAMPLE_BYTES];
+	packTelemetryHeader(header, &headerBytes[0]);
+
+	long file = fileOpenWrite(fileName);
+	if (file < 0)
+	{
+		writeDebugStreamLine("saveTelemetry(): cannot open %s, writing to the debug stream", fileName);
+		writeHexLine("TLM", &headerBytes[0], TELEMETRY_HEADER_BYTES);
+		for (long i = first; i < telemetryCount; i++)
+		{
+			packTelemetrySample(&telemetry[i % TELEMETRY_SAMPLES], &sampleBytes[0]);
+			writeHexLine("TLM", &sampleBytes[0], TELEMETRY_SAMPLE_BYTES);
+		}
+		return false;
+	}
+
+	bool okay = fileWriteData(file, &headerBytes[0], TELEMETRY_HEADER_BYTES);
+	for (long i = first; i < telemetryCount && okay; i++)
+	{
+		packTelemetrySample(&telemetry[i % TELEMETRY_SAMPLES], &sampleBytes[0]);
+		okay = fileWriteData(file, &sampleBytes[0], TELEMETRY_SAMPLE_BYTES);
+	}
+	return fileClose(file) && okay;
+}
+
+#endif // __UW_TELEMETRY_C__
@@ -47,10 +47,21 @@
  *         Changed clearI2CError to take ubyte for address, thanks Aswin
  * - 0.15: Removed motor mux and sensor mux functions and types out
  * - 0.16: Added max() and min() functions by Mike Henning, Max Bareiss
+ * - 0.17: waitForI2CBus() gives up after i2cTimeout ms instead of waiting forever, yields
+ *         instead of sleeping between polls and keeps a per-port latency histogram<br>
+ *         Added waitForI2CBusUntil(), i2cLatencyPercentile() and dumpI2CLatency()
+ * - 0.18: The I2C port type check moved out of writeI2C() into checkI2CPort(), which drivers call
+ *         once when they configure a sensor
+ * - 0.19: Added tI2CTransaction, built once per device register with initI2CTransaction() and run
+ *         with transactI2C() or startI2CTransaction()/finishI2CTransaction()<br>
+ *         The writeI2C() overloads share one send and one finish path with it
+ * - 0.20: waitForI2CBusUntil() sleeps between polls again, abortTimeslice() starved the tasks below
+ *         the caller's priority<br>
+ *         Waits the first poll ends are recorded in the latency histogram too
  *
  * \author Xander Soldaat (xander_at_botbench.com)
  * \date 27 April 2011
- * \version 0.16
+ * \version 0.20
  */
 
 #pragma systemFile
@@ -153,6 +164,16 @@ typedef struct
   TSensorTypes type;
 } tI2CData, *tI2CDataPtr;
 
+/**
+ * One I2C transaction with a register of a device, see initI2CTransaction()
+ */
+typedef struct
+{
+  ubyte message[MAX_ARR_SIZE];  /*!< size, address, register and data bytes, as sendI2CMsg() takes them */
+  ubyte replyLen;               /*!< bytes to read back, 0 for a write */
+  tSensors port;
+} tI2CTransaction, *tI2CTransactionPtr;
+
 /**
  * Array of bytes as a struct, this is a work around for RobotC's inability to pass an array to
  * a function.
@@ -169,12 +190,37 @@ typedef ubyte tIPaddr[4];                     /*!< Struct for holding an IP addr
  * a function.
  */
 typedef short tIntArray[MAX_ARR_SIZE];
+
+#ifndef I2C_TIMEOUT
+/**
+ * Default number of ms a transaction may stay pending before waitForI2CBus() gives up,
+ * can be overridden in your own program.
+ */
+#define I2C_TIMEOUT 25
+#endif
+
+/**
+ * Number of 1 ms buckets in the I2C latency histogram, the last one counts everything longer
+ */
+#define I2C_LATENCY_BUCKETS 32
+
+long i2cTimeout = I2C_TIMEOUT;                              /*!< ms waitForI2CBus() waits before giving up */
+long i2cLatency[kNumbOfRealSensors][I2C_LATENCY_BUCKETS];  /*!< completed waits per port, by ms waited */
+long i2cTimeouts[kNumbOfRealSensors];                       /*!< waits per port that ran into the deadline */
+bool i2cPortChecked[kNumbOfRealSensors];                    /*!< ports checkI2CPort() has accepted */
 void clearI2CError(tSensors link, ubyte address);
 void clearI2Cbus(tSensors link);
 
+bool checkI2CPort(tSensors link);
 bool waitForI2CBus(tSensors link);
+bool waitForI2CBusUntil(tSensors link, long deadline);
 bool writeI2C(tSensors link, tByteArray &request, tByteArray &reply, short replylen);
 bool writeI2C(tSensors link, tByteArray &request);
+bool initI2CTransaction(tI2CTransactionPtr transaction, tSensors link, ubyte address, ubyte reg, short replylen);
+void addI2CByte(tI2CTransactionPtr transaction, ubyte value);
+bool startI2CTransaction(tI2CTransactionPtr transaction);
+bool finishI2CTransaction(tI2CTransactionPtr transaction, ubyte *reply);
+bool transactI2C(tI2CTransactionPtr transaction, ubyte *reply);
 
 /**
  * Clear out the error state on I2C bus by sending a bunch of dummy
@@ -227,12 +273,31 @@ void clearI2CError(tSensors link, ubyte address) {
 //#endif
 
 /**
- * Wait for the I2C bus to be ready for the next message
+ * Add a completed wait to a port's latency histogram
  * @param link the port number
- * @return true if no error occured, false if it did
+ * @param waited ms the wait took
  */
-bool waitForI2CBus(tSensors link)
+void recordI2CLatency(tSensors link, long waited)
 {
+  if (waited >= I2C_LATENCY_BUCKETS)
+    waited = I2C_LATENCY_BUCKETS - 1;
+  i2cLatency[link][waited]++;
+}
+
+/**
+ * Wait for the I2C bus to be ready for the next message, giving up at a deadline
+ *
+ * Sleeps 1 ms between polls: the caller may be a high priority task, and yielding with
+ * abortTimeslice() would never let the lower priority ones run.  Every wait is added to the
+ * port's latency histogram, including those the first poll ends.
+ * @param link the port number
+ * @param deadline nSysTime after which to give up
+ * @return true if no error occured, false if it did or the deadline passed
+ */
+bool waitForI2CBusUntil(tSensors link, long deadline)
+{
+  long start = nSysTime;
+
   while (true)
   {
     TI2CStatus i2cstatus = nI2CStatus[link];
@@ -243,6 +308,7 @@ bool waitForI2CBus(tSensors link)
     {
 #if defined(NXT)
       case NO_ERR:
+        recordI2CLatency(link, nSysTime - start);
         return true;
 
       case STAT_COMM_PENDING:
@@ -255,6 +321,7 @@ bool waitForI2CBus(tSensors link)
 #else  // this must be an EV3
 			case i2cStatusStopped:
       case i2cStatusNoError:
+        recordI2CLatency(link, nSysTime - start);
         return true;
 
       case i2cStatusPending:
@@ -270,67 +337,92 @@ bool waitForI2CBus(tSensors link)
   #endif // __COMMON_H_DEBUG__
         return false;
     }
+
+    if (nSysTime - deadline >= 0)
+    {
+      i2cTimeouts[link]++;
+#ifdef DEBUG_COMMON_H
+      writeDebugStreamLine("waitForI2CBus: port %d still pending after %d ms", link, nSysTime - start);
+#endif // DEBUG_COMMON_H
+      return false;
+    }
     sleep(1);
   }
 }
 
-
-
 /**
- * Wait for the I2C bus to be ready for the next message
+ * Wait for the I2C bus to be ready for the next message, for at most i2cTimeout ms
  * @param link the port number
  * @return true if no error occured, false if it did
  */
-bool waitForI2CBus(tI2CDataPtr data)
+bool waitForI2CBus(tSensors link)
 {
-  while (true)
-  {
-    //i2cstatus = nI2CStatus[link];
-    switch (nI2CStatus[data->port])
-    //switch(i2cstatus)
-    {
-#ifdef NXT
-      case NO_ERR:
-        return true;
-
-      case STAT_COMM_PENDING:
-        break;
+  return waitForI2CBusUntil(link, nSysTime + i2cTimeout);
+}
 
-      case ERR_COMM_CHAN_NOT_READY:
-        break;
+/**
+ * Wait for the I2C bus to be ready for the next message, for at most i2cTimeout ms
+ * @param data the I2C data struct of the sensor
+ * @return true if no error occured, false if it did
+ */
+bool waitForI2CBus(tI2CDataPtr data)
+{
+  return waitForI2CBusUntil(data->port, nSysTime + i2cTimeout);
+}
 
-      case ERR_COMM_BUS_ERR:
-#else  // this must be an EV3
-			case i2cStatusStopped:
-      case i2cStatusNoError:
-        return true;
+/**
+ * Bus latency at a percentile of the waits recorded on a port
+ * @param link the port number
+ * @param percent percentile to look up, 0 to 100
+ * @return latency in ms, I2C_LATENCY_BUCKETS - 1 meaning that or more, -1 if nothing was recorded
+ */
+short i2cLatencyPercentile(tSensors link, float percent)
+{
+  long total = 0;
+  for (short i = 0; i < I2C_LATENCY_BUCKETS; i++)
+    total += i2cLatency[link][i];
+  if (total == 0)
+    return -1;
+
+  long count = 0;
+  for (short i = 0; i < I2C_LATENCY_BUCKETS; i++)
+  {
+    count += i2cLatency[link][i];
+    if (count * 100 >= percent * total)
+      return i;
+  }
+  return I2C_LATENCY_BUCKETS - 1;
+}
 
-      case i2cStatusPending:
-      case i2cStatusStartTransfer:
-        break;
+/**
+ * Write a port's bus latency summary and histogram to the debug stream
+ * @param link the port number
+ */
+void dumpI2CLatency(tSensors link)
+{
+  long total = 0;
+  for (short i = 0; i < I2C_LATENCY_BUCKETS; i++)
+    total += i2cLatency[link][i];
 
-      case i2cStatusFailed:
-      case i2cStatusBadConfig:
-#endif
-  #ifdef __COMMON_H_DEBUG__
-        playSound(soundLowBuzz);
-        while (bSoundActive) {}
-  #endif // __COMMON_H_DEBUG__
-        return false;
-    }
-    sleep(1);
+  writeDebugStreamLine("I2C port %d: %d waits, p50 %d ms, p99 %d ms, %d timeouts", link, total,
+    i2cLatencyPercentile(link, 50), i2cLatencyPercentile(link, 99), i2cTimeouts[link]);
+  for (short i = 0; i < I2C_LATENCY_BUCKETS; i++)
+  {
+    if (i2cLatency[link][i] > 0)
+      writeDebugStreamLine("  %2d%s ms: %d", i, (i == I2C_LATENCY_BUCKETS - 1) ? "+" : " ", i2cLatency[link][i]);
   }
 }
 
-bool writeI2C(tI2CDataPtr data) {
-#ifdef DEBUG_COMMON_H
-	writeDebugStreamLine("writeI2C(tI2CDataPtr data) called"); sleep(200);
-#endif // DEBUG_COMMON_H
-
+/**
+ * Check that a port is set up for I2C, stopping the program if it is not.  Drivers call this once
+ * when they configure a sensor, so the check does not have to run on every transaction.
+ * @param link the port number
+ * @return true if the port can be used for I2C
+ */
+bool checkI2CPort(tSensors link)
+{
 #if (__COMMON_H_SENSOR_CHECK__ == 1)
-  //TSensorTypes type = SensorType[link];
-
-  switch (SensorType[data->port])
+  switch (SensorType[link])
   {
   	case sensorSONAR:											break;
     case sensorI2CCustom:                 break;
@@ -353,140 +445,196 @@ bool writeI2C(tI2CDataPtr data) {
 #endif // EV3
       writeDebugStreamLine("ERROR, You have not setup the sensor port correctly. ");
       writeDebugStreamLine("Please refer to one of the examples.");
-      writeDebugStreamLine("Detected SensorType on port[%d]: %d", data->port, SensorType[data->port]);
+      writeDebugStreamLine("Detected SensorType on port[%d]: %d", link, SensorType[link]);
       sleep(10000);
       stopAllTasks();
+      return false;
   }
 #endif // __COMMON_H_SENSOR_CHECK__
 
+  i2cPortChecked[link] = true;
+  return true;
+}
+
+/**
+ * Send a message, without waiting for the reply.  On the NXT this first waits for the bus to
+ * be free, clearing it once if it is not.
+ *
+ * Note: this is an internal function and should not be called directly.
+ * @param link the port number
+ * @param message size, address, register and data bytes, as sendI2CMsg() takes them
+ * @param replylen the number of bytes (if any) expected in reply
+ * @return true if no error occured, false if it did
+ */
+bool _i2cSend(tSensors link, ubyte *message, short replylen) {
+// This is not required for the EV3
 #ifdef NXT
-  if (!waitForI2CBus(data->port)) {
+  if (!waitForI2CBus(link)) {
 #ifdef DEBUG_COMMON_H
   	writeDebugStreamLine("waiting for the bus");
 #endif // DEBUG_COMMON_H
-    clearI2CError(data->port, data->address);
+    clearI2CError(link, message[1]);
 
     // Let's try the bus again, see if the above packets flushed it out
     // clearI2CBus(link);
-    if (!waitForI2CBus(data->port))
+    if (!waitForI2CBus(link))
       return false;
   }
-#endif
-
-#ifdef DEBUG_COMMON_H
-  writeDebugStreamLine("writeI2C: port: %d, addr: 0x%02X, len: %d", data->port, data->address, data->requestLen); sleep(200);
-#endif
+#endif // NXT
 
 #ifdef DEBUG_COMMON_H
-  writeDebugStream("writeI2C: data->request: ");
-	for (int i = 0; i < (data->requestLen + 1); i++)
+  writeDebugStream("writeI2C: port: %d, message: ", link);
+	for (int i = 0; i < (message[0] + 1); i++)
 	{
-		writeDebugStream("0x%02X ", data->request[i]);
+		writeDebugStream("0x%02X ", message[i]);
 	}
 	writeDebugStream("\n");
 #endif // DEBUG_COMMON_H
 
-  sendI2CMsg(data->port, &data->request[0], data->replyLen);
+  sendI2CMsg(link, message, replylen);
+  return true;
+}
 
-  if (!waitForI2CBus(data)) {
+/**
+ * Wait for a message sent with _i2cSend() to go through and read its reply.  On the NXT a
+ * message that fails is sent once more.
+ *
+ * Note: this is an internal function and should not be called directly.
+ * @param link the port number
+ * @param message the message that was sent
+ * @param reply where to put the reply
+ * @param replylen the number of bytes (if any) expected in reply
+ * @return true if no error occured, false if it did
+ */
+bool _i2cFinish(tSensors link, ubyte *message, ubyte *reply, short replylen) {
+  if (!waitForI2CBus(link)) {
 #ifdef EV3
 	#ifdef DEBUG_COMMON_H
 			writeDebugStreamLine("waiting for the bus has failed");	 sleep(200);
 	#endif
 		return false;
 #else
-    clearI2CError(data->port, data->address);
-    sendI2CMsg(data->port, &data->request[0], data->replyLen);
-    if (!waitForI2CBus(data))
+    clearI2CError(link, message[1]);
+    sendI2CMsg(link, message, replylen);
+    if (!waitForI2CBus(link))
       return false;
 #endif
   }
 
-  if (data->replyLen == 0)
+  if (replylen == 0)
     return true;
-#ifdef DEBUG_COMMON_H
-  writeDebugStreamLine("writeI2C: initiating read: data->replyLen: %d", data->replyLen); sleep(200);
-#endif // DEBUG_COMMON_H
 
-  readI2CReply(data->port, &data->reply[0], data->replyLen);
+  // ask for the input to put into the data array
+  readI2CReply(link, reply, replylen);
 
 #ifdef EV3
-	return waitForI2CBus(data);
+	return waitForI2CBus(link);
 #else
 	return true;
 #endif // EV3
 }
 
 /**
- * Write to the I2C bus. This function will clear the bus and wait for it be ready
- * before any bytes are sent.
+ * Set up a transaction with one register of a device.  The message is built here, once, and
+ * the port checked; the transaction can then be run any number of times, by any task that
+ * owns it, without rebuilding or clearing anything.  Use addI2CByte() to add data to write.
+ * @param transaction the transaction to set up
  * @param link the port number
- * @param request the data to be sent
+ * @param address the device's I2C address
+ * @param reg the register to read or write
+ * @param replylen the number of bytes (if any) expected in reply
+ * @return true if the port is set up for I2C, false if it is not
+ */
+bool initI2CTransaction(tI2CTransactionPtr transaction, tSensors link, ubyte address, ubyte reg, short replylen)
+{
+  transaction->port = link;
+  transaction->message[0] = 2;            // Message size
+  transaction->message[1] = address;      // I2C Address
+  transaction->message[2] = reg;
+  transaction->replyLen = replylen;
+  return checkI2CPort(link);
+}
+
+/**
+ * Add a data byte to the message of a transaction
+ * @param transaction the transaction set up with initI2CTransaction()
+ * @param value the byte to send after the register and any bytes added before
+ */
+void addI2CByte(tI2CTransactionPtr transaction, ubyte value)
+{
+  transaction->message[0]++;
+  transaction->message[transaction->message[0]] = value;
+}
+
+/**
+ * Start a transaction without waiting for it, so that other work can be done while it is on
+ * the bus.  Finish it with finishI2CTransaction() before anything else uses the port.
+ * @param transaction the transaction set up with initI2CTransaction()
  * @return true if no error occured, false if it did
  */
-bool writeI2C(tSensors link, tByteArray &request) {
+bool startI2CTransaction(tI2CTransactionPtr transaction)
+{
+  return _i2cSend(transaction->port, &transaction->message[0], transaction->replyLen);
+}
 
-#if (__COMMON_H_SENSOR_CHECK__ == 1)
-  //TSensorTypes type = SensorType[link];
+/**
+ * Wait for a transaction started with startI2CTransaction() and read its reply
+ * @param transaction the transaction
+ * @param reply where to put the reply, replyLen bytes of storage owned by the caller
+ * @return true if no error occured, false if it did
+ */
+bool finishI2CTransaction(tI2CTransactionPtr transaction, ubyte *reply)
+{
+  return _i2cFinish(transaction->port, &transaction->message[0], reply, transaction->replyLen);
+}
 
-  switch (SensorType[link])
-  {
-  	case sensorSONAR:											break;
-    case sensorI2CCustom:                 break;
-    case sensorI2CCustom9V:               break;
-#ifdef EV3
-		case sensorEV3_EnergyMeter:						break;  // for some reason, some I2C sensors are identified as this
-		case sensorEV3_GenericI2C:						break;
-#else // This is an NXT
-    case sensorI2CCustomFast:             break;
-    case sensorI2CCustomFast9V:           break;
-    case sensorI2CCustomFastSkipStates9V: break;
-    case sensorI2CCustomFastSkipStates:   break;
-#endif // EV3/NXT
-    default:
-      hogCPU();
-      playSound(soundException);
-      eraseDisplay();
-#ifdef EV3
-			setLEDColor(ledRedPulse);
-#endif // EV3
-      writeDebugStreamLine("ERROR, You have not setup the sensor port correctly. ");
-      writeDebugStreamLine("Please refer to one of the examples.");
-      writeDebugStreamLine("Detected SensorType on port[%d]: %d", link, SensorType[link]);
-      sleep(10000);
-      stopAllTasks();
-    }
-#endif
+/**
+ * Run a transaction: send its message and wait for the reply
+ * @param transaction the transaction set up with initI2CTransaction()
+ * @param reply where to put the reply, replyLen bytes of storage owned by the caller
+ * @return true if no error occured, false if it did
+ */
+bool transactI2C(tI2CTransactionPtr transaction, ubyte *reply)
+{
+  if (!_i2cSend(transaction->port, &transaction->message[0], transaction->replyLen))
+    return false;
+  return _i2cFinish(transaction->port, &transaction->message[0], reply, transaction->replyLen);
+}
 
-// This is not required for the EV3
-#ifdef NXT
-  if (!waitForI2CBus(link)) {
-    clearI2CError(link, request[1]);
+/**
+ * Write to the I2C bus and read the reply, if any, into the data struct.
+ * Prefer a tI2CTransaction, which does not have to check the port on every call.
+ * @param data the I2C data struct of the sensor
+ * @return true if no error occured, false if it did
+ */
+bool writeI2C(tI2CDataPtr data) {
+#ifdef DEBUG_COMMON_H
+	writeDebugStreamLine("writeI2C(tI2CDataPtr data) called"); sleep(200);
+#endif // DEBUG_COMMON_H
 
-    // Let's try the bus again, see if the above packets flushed it out
-    // clearI2CBus(link);
-    if (!waitForI2CBus(link))
-      return false;
-  }
-#endif // __COMMON_H_SENSOR_CHECK__
+  // ports are normally checked when their sensor is configured, this catches the ones that were not
+  if (!i2cPortChecked[data->port] && !checkI2CPort(data->port))
+    return false;
 
-  sendI2CMsg(link, &request[0], 0);
+  if (!_i2cSend(data->port, &data->request[0], data->replyLen))
+    return false;
+  return _i2cFinish(data->port, &data->request[0], &data->reply[0], data->replyLen);
+}
 
-  if (!waitForI2CBus(link)) {
-#ifdef EV3
-	#ifdef DEBUG_COMMON_H
-			writeDebugStreamLine("waiting for the bus has failed");	 sleep(200);
-	#endif
-		return false;
-#else
-    clearI2CError(link, request[1]);
-    sendI2CMsg(link, &request[0], 0);
-    if (!waitForI2CBus(link))
-      return false;
-#endif
-  }
+/**
+ * Write to the I2C bus. This function will clear the bus and wait for it be ready
+ * before any bytes are sent.
+ * @param link the port number
+ * @param request the data to be sent
+ * @return true if no error occured, false if it did
+ */
+bool writeI2C(tSensors link, tByteArray &request) {
+  if (!i2cPortChecked[link] && !checkI2CPort(link))
+    return false;
 
-  return true;
+  if (!_i2cSend(link, &request[0], 0))
+    return false;
+  return _i2cFinish(link, &request[0], &request[0], 0);
 }
 
 /**
@@ -499,76 +647,12 @@ bool writeI2C(tSensors link, tByteArray &request) {
  * @return true if no error occured, false if it did
  */
 bool writeI2C(tSensors link, tByteArray &request, tByteArray &reply, short replylen) {
-  // clear the input data buffer
-
-#if (__COMMON_H_SENSOR_CHECK__ == 1)
-  //TSensorTypes type = SensorType[link];
+  if (!i2cPortChecked[link] && !checkI2CPort(link))
+    return false;
 
-  switch (SensorType[link])
-  {
-  	case sensorSONAR:											break;
-    case sensorI2CCustom:                 break;
-    case sensorI2CCustom9V:               break;
-#ifdef EV3
-		case sensorEV3_EnergyMeter:						break;  // for some reason, some I2C sensors are identified as this
-		case sensorEV3_GenericI2C:						break;
-#else // This is an NXT
-    case sensorI2CCustomFast:             break;
-    case sensorI2CCustomFast9V:           break;
-    case sensorI2CCustomFastSkipStates9V: break;
-    case sensorI2CCustomFastSkipStates:   break;
-#endif // EV3/NXT
-    default:
-      hogCPU();
-      playSound(soundException);
-      eraseDisplay();
-#ifdef EV3
-			setLEDColor(ledRedPulse);
-#endif // EV3
-      writeDebugStreamLine("ERROR, You have not setup the sensor port correctly. ");
-      writeDebugStreamLine("Please refer to one of the examples.");
-      writeDebugStreamLine("Detected SensorType on port[%d]: %d", link, SensorType[link]);
-      sleep(10000);
-      stopAllTasks();
-  }
-#endif // __COMMON_H_SENSOR_CHECK__
-
-// This is not required for the EV3
-#ifdef NXT
-  if (!waitForI2CBus(link)) {
-    clearI2CError(link, request[1]);
-
-    // Let's try the bus again, see if the above packets flushed it out
-    // clearI2CBus(link);
-    if (!waitForI2CBus(link))
-      return false;
-  }
-#endif
-
-  sendI2CMsg(link, &request[0], replylen);
-
-  if (!waitForI2CBus(link)) {
-#ifdef EV3
-	#ifdef DEBUG_COMMON_H
-			writeDebugStreamLine("waiting for the bus has failed");	 sleep(200);
-	#endif
-		return false;
-#else
-    clearI2CError(link, request[1]);
-    sendI2CMsg(link, &request[0], replylen);
-    if (!waitForI2CBus(link))
-      return false;
-#endif
-  }
-
-  // ask for the input to put into the data array
-  readI2CReply(link, &reply[0], replylen);
-
-#ifdef EV3
-	return waitForI2CBus(link);
-#else
-	return true;
-#endif // EV3
+  if (!_i2cSend(link, &request[0], replylen))
+    return false;
+  return _i2cFinish(link, &request[0], &reply[0], replylen);
 }
 
 
@@ -658,11 +742,10 @@ typedef enum tXButton
 
 bool getXbuttonValue(tXButton button)
 {
-  tXButton currButton;
 #if defined(EV3)
   return getButtonPress((TEV3Buttons)button);
 #elif defined(NXT)
-  currButton = (tXButton)nNxtButtonPressed;
+  tXButton currButton = (tXButton)nNxtButtonPressed;
   if ((button == xButtonAny) && (currButton != kNoButton))
     return true;
   else
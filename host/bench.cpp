@@ -0,0 +1,195 @@
+/*
+Coverage-per-minute benchmark
+Description: Runs every mission variant through the simulated room corpus and reports, per variant, the
+coverage-vs-time curve, coverage at the end of the window, time to 90% coverage, redundant (swept more
+than once) area and collision count. The SCORE line, mean coverage at the end of the window over the
+whole corpus, is the number tracked from release to release. For the SMUX builds it also reports how
+busy the simulated I2C bus was and the touch-poll latency; arguments after -- (e.g. --i2c byte=500) go to
+every mission.
+
+The operator enters one minute more than the window: the missions' duration prompt treats Enter like
+Down, so entering N minutes runs for N - 1.
+
+Usage: bin/bench [--rooms DIR] [--seeds N] [--window MINUTES] [--variants A,B,...] [--jobs N]
+                 [-- mission arguments...]
+*/
+
+#include "runner.h"
+#include "work_pool.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+
+struct VariantSummary
+{
+	VariantSummary()
+		: runs(0), failed(0), reached(0), i2cRuns(0), coverage(0), t90(0), redundant(0), collisions(0), i2cBusy(0),
+		  touchP50(0), touchP99(0)
+	{
+	}
+
+	int runs, failed, reached, i2cRuns;
+	double coverage, t90, redundant, collisions, i2cBusy, touchP50, touchP99;
+	std::vector<double> curve;
+};
+
+static int usage(const char *argv0)
+{
+	fprintf(stderr, "usage: %s [--rooms DIR] [--seeds N] [--window MINUTES] [--variants A,B,...] [--jobs N]\n"
+					"       [-- mission arguments...]\n", argv0);
+	return 2;
+}
+
+int main(int argc, char **argv)
+{
+	std::string binDir = executableDir(argv[0]);
+	std::string roomDir = binDir + "/../rooms";
+	std::vector<std::string> variants = allVariants();
+	std::vector<std::string> missionArgs;
+	int seeds = 3, window = 5, jobs = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--")
+		{
+			missionArgs.assign(argv + i + 1, argv + argc);
+			break;
+		}
+		else if (arg == "--rooms" && hasValue)
+			roomDir = argv[++i];
+		else if (arg == "--seeds" && hasValue)
+			seeds = atoi(argv[++i]);
+		else if (arg == "--window" && hasValue)
+			window = atoi(argv[++i]);
+		else if (arg == "--jobs" && hasValue)
+			jobs = atoi(argv[++i]);
+		else if (arg == "--variants" && hasValue)
+		{
+			variants.clear();
+			std::istringstream list(argv[++i]);
+			std::string name;
+			while (std::getline(list, name, ','))
+				variants.push_back(name);
+		}
+		else
+			return usage(argv[0]);
+	}
+
+	std::vector<std::string> rooms = listRooms(roomDir);
+	if (rooms.empty())
+	{
+		fprintf(stderr, "no rooms in %s\n", roomDir.c_str());
+		return 2;
+	}
+
+	std::vector<MissionJob> batch;
+	for (size_t v = 0; v < variants.size(); v++)
+	{
+		for (size_t r = 0; r < rooms.size(); r++)
+		{
+			for (int seed = 1; seed <= seeds; seed++)
+			{
+				MissionJob job = {variants[v], rooms[r], (unsigned)seed, window + 1, missionArgs};
+				batch.push_back(job);
+			}
+		}
+	}
+
+	std::vector<MissionResult> results(batch.size());
+	std::vector<char> ok(batch.size());
+	WorkStealingPool pool(jobs);
+	pool.run(batch.size(), [&](size_t index) { ok[index] = runMission(binDir, batch[index], &results[index]); });
+
+	// one curve point per 30 s of the window
+	const int POINTS = window * 2;
+	std::vector<VariantSummary> summaries(variants.size());
+
+	for (size_t v = 0; v < variants.size(); v++)
+		summaries[v].curve.assign(POINTS, 0);
+
+	for (size_t i = 0; i < batch.size(); i++)
+	{
+		VariantSummary &summary = summaries[(i / seeds) / rooms.size()];
+		const MissionResult &result = results[i];
+
+		if (!ok[i])
+		{
+			summary.failed++;
+			continue;
+		}
+
+		double t90 = result.number("t90", -1);
+		summary.runs++;
+		summary.coverage += result.coverageAt(window * 60);
+		summary.redundant += result.number("redundant_m2", 0);
+		summary.collisions += result.number("collisions", 0);
+		if (t90 >= 0 && t90 <= window * 60)
+		{
+			summary.reached++;
+			summary.t90 += t90;
+		}
+		for (int p = 0; p < POINTS; p++)
+			summary.curve[p] += result.coverageAt((p + 1) * 30);
+		if (result.number("i2c_txns", 0) > 0)
+		{
+			summary.i2cRuns++;
+			summary.i2cBusy += result.number("i2c_busy_pct", 0);
+			summary.touchP50 += result.number("touch_p50_ms", 0);
+			summary.touchP99 += result.number("touch_p99_ms", 0);
+		}
+	}
+
+	printf("%d rooms x %d seeds, %d minute window\n\n", (int)rooms.size(), seeds, window);
+	printf("%-26s %8s %8s %8s %13s %10s %9s %16s\n", "variant", "coverage", "t90 s", "reached", "redundant m2",
+		   "collisions", "i2c busy", "touch p50/p99 ms");
+	for (size_t v = 0; v < variants.size(); v++)
+	{
+		const VariantSummary &s = summaries[v];
+		int n = s.runs > 0 ? s.runs : 1;
+		char t90[16];
+		if (s.reached > 0)
+			snprintf(t90, sizeof(t90), "%.0f", s.t90 / s.reached);
+		else
+			snprintf(t90, sizeof(t90), "-");
+		char busy[16], touch[32];
+		if (s.i2cRuns > 0)
+		{
+			snprintf(busy, sizeof(busy), "%.1f%%", s.i2cBusy / s.i2cRuns);
+			snprintf(touch, sizeof(touch), "%.0f/%.0f", s.touchP50 / s.i2cRuns, s.touchP99 / s.i2cRuns);
+		}
+		else
+		{
+			snprintf(busy, sizeof(busy), "-");
+			snprintf(touch, sizeof(touch), "-");
+		}
+		printf("%-26s %7.1f%% %8s %4d/%-3d %13.2f %10.1f %9s %16s%s\n", variants[v].c_str(), s.coverage / n, t90,
+			   s.reached, s.runs, s.redundant / n, s.collisions / n, busy, touch,
+			   s.failed ? "  (some runs failed)" : "");
+	}
+
+	printf("\ncoverage vs time, %% of cleanable floor\n%-26s", "variant");
+	for (int p = 0; p < POINTS; p++)
+		printf(" %2d:%02d", (p + 1) * 30 / 60, (p + 1) * 30 % 60);
+	printf("\n");
+	for (size_t v = 0; v < variants.size(); v++)
+	{
+		const VariantSummary &s = summaries[v];
+		int n = s.runs > 0 ? s.runs : 1;
+		printf("%-26s", variants[v].c_str());
+		for (int p = 0; p < POINTS; p++)
+			printf(" %5.1f", s.curve[p] / n);
+		printf("\n");
+	}
+
+	printf("\n");
+	for (size_t v = 0; v < variants.size(); v++)
+	{
+		int n = summaries[v].runs > 0 ? summaries[v].runs : 1;
+		printf("SCORE %s %.2f\n", variants[v].c_str(), summaries[v].coverage / n);
+	}
+	return 0;
+}
@@ -0,0 +1,113 @@
+#include "coverage.h"
+
+#include <cmath>
+
+const double CELL = 2;				   // cm
+const long long NEW_PASS_US = 1000000; // a cell untouched this long is being swept again
+
+CoverageGrid::CoverageGrid(const RoomSim &sim, double sampleSeconds)
+	: sim_(sim), sampleSeconds_(sampleSeconds), freeCells_(0), coveredCells_(0), extraPasses_(0), t90_(-1),
+	  havePose_(false)
+{
+	const Room &room = sim.room();
+
+	cols_ = (int)ceil((room.upper.x - room.lower.x) / CELL);
+	rows_ = (int)ceil((room.upper.y - room.lower.y) / CELL);
+	free_.assign(cols_ * rows_, false);
+	passes_.assign(cols_ * rows_, 0);
+	lastSweptUs_.assign(cols_ * rows_, 0);
+
+	for (int row = 0; row < rows_; row++)
+	{
+		for (int col = 0; col < cols_; col++)
+		{
+			Vec2 centre = {room.lower.x + (col + 0.5) * CELL, room.lower.y + (row + 0.5) * CELL};
+			if (room.isFree(centre))
+			{
+				free_[row * cols_ + col] = true;
+				freeCells_++;
+			}
+		}
+	}
+}
+
+void CoverageGrid::tick(long long nowUs)
+{
+	long long startUs = halMissionStartUs();
+	if (startUs < 0 || !sim_.started())
+		return;
+
+	// the drum only cleans while it is spinning, and the missions stop it for most turns
+	if (motor[motorB] != 0)
+		sweep(nowUs);
+
+	double missionSeconds = (nowUs - startUs) / 1e6;
+	while (curve_.size() * sampleSeconds_ <= missionSeconds)
+		curve_.push_back(coverage());
+	if (t90_ < 0 && coverage() >= 0.9)
+		t90_ = missionSeconds;
+}
+
+/**
+ * @brief Mark the cells under the drum at the current pose
+ *
+ * Only re-rasterises once the robot has moved a cell or turned a few degrees.
+ */
+void CoverageGrid::sweep(long long nowUs)
+{
+	const SimPose &pose = sim_.pose();
+	const SimConfig &config = sim_.config();
+	const Room &room = sim_.room();
+
+	if (havePose_ && hypot(pose.x - lastPose_.x, pose.y - lastPose_.y) < CELL / 2 &&
+		fabs(pose.heading - lastPose_.heading) < 3)
+		return;
+	lastPose_ = pose;
+	havePose_ = true;
+
+	double h = pose.heading * PI / 180;
+	double fx = cos(h), fy = sin(h);
+	double halfWidth = config.drumWidth / 2, halfDepth = config.drumDepth / 2;
+	double cx = pose.x + fx * config.drumOffset, cy = pose.y + fy * config.drumOffset;
+	double reach = hypot(halfWidth, halfDepth);
+
+	int col0 = (int)floor((cx - reach - room.lower.x) / CELL), col1 = (int)floor((cx + reach - room.lower.x) / CELL);
+	int row0 = (int)floor((cy - reach - room.lower.y) / CELL), row1 = (int)floor((cy + reach - room.lower.y) / CELL);
+
+	for (int row = row0 > 0 ? row0 : 0; row <= row1 && row < rows_; row++)
+	{
+		for (int col = col0 > 0 ? col0 : 0; col <= col1 && col < cols_; col++)
+		{
+			int index = row * cols_ + col;
+			if (!free_[index])
+				continue;
+
+			double dx = room.lower.x + (col + 0.5) * CELL - cx, dy = room.lower.y + (row + 0.5) * CELL - cy;
+			double along = dx * fx + dy * fy, across = -dx * fy + dy * fx;
+			if (fabs(along) > halfDepth || fabs(across) > halfWidth)
+				continue;
+
+			if (passes_[index] == 0)
+			{
+				passes_[index] = 1;
+				coveredCells_++;
+			}
+			else if (nowUs - lastSweptUs_[index] > NEW_PASS_US && passes_[index] < 0xFFFF)
+			{
+				passes_[index]++;
+				extraPasses_++;
+			}
+			lastSweptUs_[index] = nowUs;
+		}
+	}
+}
+
+double CoverageGrid::coverage() const
+{
+	return freeCells_ > 0 ? (double)coveredCells_ / freeCells_ : 0;
+}
+
+double CoverageGrid::redundantArea() const
+{
+	return extraPasses_ * CELL * CELL / 10000;
+}
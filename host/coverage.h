@@ -0,0 +1,67 @@
+/*
+Ground truth coverage for the host simulator
+Description: Rasterises the room's cleanable area into 2 cm cells and marks every cell the drum passes
+over while it is spinning. Keeps the coverage-vs-time curve, the time the mission first reached 90%, and
+how much floor was swept more than once.
+*/
+
+#ifndef __COVERAGE_H__
+#define __COVERAGE_H__
+
+#include "sim.h"
+
+#include <vector>
+
+class CoverageGrid : public HalTicker
+{
+public:
+	/**
+	 * @brief Create a grid over the simulated room
+	 *
+	 * @param sim the simulator whose pose is tracked
+	 * @param sampleSeconds interval of the coverage-vs-time curve
+	 */
+	CoverageGrid(const RoomSim &sim, double sampleSeconds);
+
+	void tick(long long nowUs);
+
+	/**
+	 * @brief Fraction of cleanable cells swept so far, 0 to 1
+	 */
+	double coverage() const;
+
+	/**
+	 * @brief Mission seconds at which coverage first reached 90%, or -1
+	 */
+	double timeTo90() const { return t90_; }
+
+	/**
+	 * @brief Floor swept more than once, in square metres, counting every extra pass
+	 */
+	double redundantArea() const;
+
+	/**
+	 * @brief Coverage sampled every sampleSeconds of mission time, starting at 0
+	 */
+	const std::vector<double> &curve() const { return curve_; }
+
+	double sampleSeconds() const { return sampleSeconds_; }
+
+private:
+	void sweep(long long nowUs);
+
+	const RoomSim &sim_;
+	double sampleSeconds_;
+	int cols_, rows_;
+	std::vector<bool> free_;
+	std::vector<unsigned short> passes_;
+	std::vector<long long> lastSweptUs_;
+	int freeCells_, coveredCells_;
+	long extraPasses_;
+	double t90_;
+	SimPose lastPose_;
+	bool havePose_;
+	std::vector<double> curve_;
+};
+
+#endif // __COVERAGE_H__
@@ -0,0 +1,11 @@
+/*
+Host stand-in for the RobotC firmwareVersion.h that common.h checks against.
+The host HAL implements the RobotC 4.x EV3 API, so report a matching version.
+*/
+
+#ifndef __FIRMWAREVERSION_H__
+#define __FIRMWAREVERSION_H__
+
+#define kRobotCVersionNumeric 452
+
+#endif // __FIRMWAREVERSION_H__
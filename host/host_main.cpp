@@ -0,0 +1,297 @@
+/*
+Host driver for one RobotC mission
+Description: Runs the mission's task main on the virtual clock with the scripted operator answering the
+startup prompts, then reports how much virtual and wall time the run took. With --room the robot drives
+around the simulated room instead of an empty floor and the report adds coverage, time to 90% coverage,
+redundant area, collisions and the coverage curve sampled every 30 s of mission time. --i2c sets the
+SMUX bus timing (see SmuxTiming::parse) and the report gives the bus load and the touch-poll latency.
+--datalog gives the mission a directory to write its files to (telemetry, see bin/teledecode, and the
+recording of its inputs). --replay runs the mission on the inputs recorded on the robot instead of the
+room and the operator (see replay.h); --commands writes every change of the motor powers to a CSV file,
+so a replay can be compared with the run it was recorded from or with another replay. --mode picks the
+cleaning mode by the name the mission shows for it (random, lanes or frontier), in missions that ask for
+one (default random), and --target the coverage in percent to stop at, with --minutes as the time cap
+(0 to 100 in the missions' steps of 5, default 0, no target). The target is checked against the
+coverage map's estimate, which the missions require to clear it by a margin.
+
+Usage: bin/<variant> [--room FILE] [--minutes N] [--edges N] [--tape COLOUR] [--mode NAME]
+                     [--target PERCENT] [--seed N] [--limit MINUTES] [--wheelbase CM] [--sim-hz HZ]
+                     [--gyro-drift DEG_PER_MIN] [--motor-mismatch FRACTION] [--i2c TIMING] [--trace FILE]
+                     [--datalog DIR] [--replay FILE] [--commands FILE] [--verbose]
+*/
+
+#include "coverage.h"
+#include "operator.h"
+#include "replay.h"
+#include "smux_device.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+// the cleaning modes the operator can pick, by the names the missions show for them
+static const char *MODES[] = {"random", "lanes", "frontier"};
+static const int NUMB_OF_MODES = 3;
+
+// the missions step the target coverage by TARGET_STEP percent up to 100
+static const int TARGET_STEP = 5;
+
+/**
+ * @brief Writes the robot's pose to a CSV file every 100 ms of virtual time
+ */
+class PoseTrace : public HalTicker
+{
+public:
+	PoseTrace(const RoomSim &sim, FILE *file) : sim_(sim), file_(file), nextUs_(0)
+	{
+		fprintf(file_, "t,x,y,heading\n");
+	}
+
+	void tick(long long nowUs)
+	{
+		if (nowUs < nextUs_ || !sim_.started())
+			return;
+		const SimPose &pose = sim_.pose();
+		fprintf(file_, "%.1f,%.1f,%.1f,%.1f\n", nowUs / 1e6, pose.x, pose.y, pose.heading);
+		nextUs_ = nowUs + 100000;
+	}
+
+private:
+	const RoomSim &sim_;
+	FILE *file_;
+	long long nextUs_;
+};
+
+/**
+ * @brief Name of the mission this binary was built from, taken from the executable name
+ */
+static const char *variantName(const char *argv0)
+{
+	const char *slash = strrchr(argv0, '/');
+	return slash ? slash + 1 : argv0;
+}
+
+static int usage(const char *argv0)
+{
+	fprintf(stderr, "usage: %s [--room FILE] [--minutes N] [--edges N] [--tape COLOUR] [--mode NAME]\n"
+					"       [--target PERCENT] [--seed N] [--limit MINUTES] [--wheelbase CM] [--sim-hz HZ]\n"
+					"       [--gyro-drift DEG_PER_MIN] [--motor-mismatch FRACTION] [--i2c TIMING] [--trace FILE]\n"
+					"       [--datalog DIR] [--replay FILE] [--commands FILE] [--verbose]\n", argv0);
+	return 2;
+}
+
+int main(int argc, char **argv)
+{
+	int minutes = 5, edges = -1, tapeColour = -1, target = 0, simHz = 1000;
+	unsigned seed = 1;
+	double limitMinutes = -1;
+	const char *roomPath = NULL, *tracePath = NULL, *replayPath = NULL, *commandsPath = NULL;
+	std::string mode = "random";
+	SimConfig config;
+	SmuxTiming timing;
+	std::string error;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--room" && hasValue)
+			roomPath = argv[++i];
+		else if (arg == "--minutes" && hasValue)
+			minutes = atoi(argv[++i]);
+		else if (arg == "--edges" && hasValue)
+			edges = atoi(argv[++i]);
+		else if (arg == "--tape" && hasValue)
+			tapeColour = atoi(argv[++i]);
+		else if (arg == "--mode" && hasValue)
+			mode = argv[++i];
+		else if (arg == "--target" && hasValue)
+			target = atoi(argv[++i]);
+		else if (arg == "--seed" && hasValue)
+			seed = strtoul(argv[++i], NULL, 10);
+		else if (arg == "--limit" && hasValue)
+			limitMinutes = atof(argv[++i]);
+		else if (arg == "--wheelbase" && hasValue)
+			config.wheelbase = atof(argv[++i]);
+		else if (arg == "--sim-hz" && hasValue)
+			simHz = atoi(argv[++i]);
+		else if (arg == "--gyro-drift" && hasValue)
+			config.gyroDriftPerMin = atof(argv[++i]);
+		else if (arg == "--motor-mismatch" && hasValue)
+			config.motorMismatch = atof(argv[++i]);
+		else if (arg == "--i2c" && hasValue)
+		{
+			if (!timing.parse(argv[++i], &error))
+			{
+				fprintf(stderr, "%s\n", error.c_str());
+				return 2;
+			}
+		}
+		else if (arg == "--trace" && hasValue)
+			tracePath = argv[++i];
+		else if (arg == "--replay" && hasValue)
+			replayPath = argv[++i];
+		else if (arg == "--commands" && hasValue)
+			commandsPath = argv[++i];
+		else if (arg == "--datalog" && hasValue)
+			halSetFileDir(argv[++i]);
+		else if (arg == "--verbose")
+			halSetVerbose(true);
+		else
+			return usage(argv[0]);
+	}
+
+	if (roomPath && replayPath)
+		return usage(argv[0]);
+
+	// the operator steps through the modes until it sees the one asked for, which would never come
+	bool knownMode = false;
+	for (int i = 0; i < NUMB_OF_MODES; i++)
+		knownMode = knownMode || mode == MODES[i];
+	if (!knownMode)
+	{
+		fprintf(stderr, "unknown mode %s, expected", mode.c_str());
+		for (int i = 0; i < NUMB_OF_MODES; i++)
+			fprintf(stderr, "%s %s", i == 0 ? "" : (i == NUMB_OF_MODES - 1 ? " or" : ","), MODES[i]);
+		fprintf(stderr, "\n");
+		return 2;
+	}
+	if (target < 0 || target > 100 || target % TARGET_STEP != 0)
+	{
+		fprintf(stderr, "target coverage %d%% cannot be picked, expected 0 to 100 in steps of %d\n", target,
+				TARGET_STEP);
+		return 2;
+	}
+
+	Room room;
+	if (roomPath && !room.load(roomPath, &error))
+	{
+		fprintf(stderr, "%s\n", error.c_str());
+		return 2;
+	}
+	Recording recording;
+	if (replayPath && !recording.load(replayPath, &error))
+	{
+		fprintf(stderr, "%s\n", error.c_str());
+		return 2;
+	}
+	if (edges < 0)
+		edges = roomPath ? room.edges : 4;
+	if (tapeColour < 0)
+		tapeColour = room.tapeColour();
+
+	// startup takes well under a minute of virtual time, so allow generous slack before giving up; a
+	// replay runs for the duration entered on the robot, which only the recording knows
+	if (limitMinutes < 0)
+		limitMinutes = replayPath ? 120 : minutes + 10;
+
+	srand(seed);
+	halSetStepRate(simHz);
+
+	RoomSim sim(room, config);
+	SmuxDevice smux(sim, timing, seed);
+	if (roomPath)
+	{
+		halSetWorld(&sim);
+		halAttachI2C(S4, &smux);
+		halAddTicker(&smux);
+	}
+
+	ReplayInputs replay(recording);
+	ReplaySmux replaySmux(replay);
+	if (replayPath)
+	{
+		halSetInputs(&replay);
+		halAttachI2C(S4, &replaySmux);
+	}
+
+	CoverageGrid coverage(sim, 30);
+	if (roomPath)
+		halAddTicker(&coverage);
+
+	FILE *traceFile = NULL;
+	PoseTrace *trace = NULL;
+	if (tracePath && roomPath)
+	{
+		traceFile = fopen(tracePath, "w");
+		if (!traceFile)
+		{
+			fprintf(stderr, "cannot write %s\n", tracePath);
+			return 2;
+		}
+		trace = new PoseTrace(sim, traceFile);
+		halAddTicker(trace);
+	}
+
+	FILE *commandsFile = NULL;
+	CommandTrace *commands = NULL;
+	if (commandsPath)
+	{
+		commandsFile = fopen(commandsPath, "w");
+		if (!commandsFile)
+		{
+			fprintf(stderr, "cannot write %s\n", commandsPath);
+			return 2;
+		}
+		commands = new CommandTrace(commandsFile);
+		halAddTicker(commands);
+	}
+
+	// a replay presses the buttons the person at the robot pressed
+	HalOperator user(edges, minutes, tapeColour, target, mode);
+	if (!replayPath)
+		halAddTicker(&user);
+	halSetTimeLimit((long long)(limitMinutes * 60e6));
+
+	bool timedOut = false;
+	std::chrono::steady_clock::time_point wallStart = std::chrono::steady_clock::now();
+	try
+	{
+		robotcMain();
+	}
+	catch (HalStop &stop)
+	{
+		timedOut = stop.timedOut;
+	}
+	double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wallStart).count();
+
+	long long startUs = halMissionStartUs();
+	printf("variant=%s room=%s seed=%u virtual_s=%.1f mission_s=%.1f wall_ms=%.1f result=%s",
+		   variantName(argv[0]), roomPath ? room.name.c_str() : (replayPath ? "replay" : "none"), seed, halNowUs() / 1e6,
+		   startUs < 0 ? 0.0 : (halNowUs() - startUs) / 1e6, wallMs, timedOut ? "timeout" : "complete");
+	if (roomPath)
+	{
+		printf(" x=%.1f y=%.1f heading=%.1f collisions=%d coverage=%.2f t90=%.1f redundant_m2=%.2f curve=",
+			   sim.pose().x, sim.pose().y, sim.pose().heading, sim.collisions(), coverage.coverage() * 100,
+			   coverage.timeTo90(), coverage.redundantArea());
+		for (size_t i = 0; i < coverage.curve().size(); i++)
+			printf("%s%.1f", i ? "/" : "", coverage.curve()[i] * 100);
+
+		// bus load and the mission's wait for it over the whole run, touch latency from press to the end
+		// of the read reporting it
+		double runUs = halNowUs() > 0 ? (double)halNowUs() : 1;
+		const std::vector<long> &latencies = smux.touchLatencies();
+		printf(" i2c_txns=%ld i2c_naks=%ld i2c_stalls=%ld i2c_busy_pct=%.1f i2c_wait_pct=%.1f"
+			   " touch_seen=%d touch_missed=%d touch_p50_ms=%.1f touch_p99_ms=%.1f touch_max_ms=%.1f",
+			   smux.transactions(), smux.naks(), smux.stalls(), smux.busyUs() * 100 / runUs,
+			   halI2CWaitUs(S4) * 100 / runUs, (int)latencies.size(), smux.touchesMissed(),
+			   percentile(latencies, 0.5) / 1e3, percentile(latencies, 0.99) / 1e3, percentile(latencies, 1) / 1e3);
+	}
+	if (replayPath)
+		printf(" replayed=%ld/%ld dropped=%ld", (long)replay.replayed(), (long)recording.events().size(),
+			   recording.dropped());
+	printf("\n");
+
+	if (traceFile)
+	{
+		fclose(traceFile);
+		delete trace;
+	}
+	if (commandsFile)
+	{
+		fclose(commandsFile);
+		delete commands;
+	}
+	return timedOut ? 1 : 0;
+}
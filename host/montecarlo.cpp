@@ -0,0 +1,239 @@
+/*
+Monte Carlo mission runner
+Description: Runs seed x room x variant batches of independent simulated missions on a work-stealing
+thread pool and reports the coverage distribution of each variant with 95% confidence intervals. Every
+mission is its own process, so the batch scales with the number of cores.
+
+Usage: bin/montecarlo [--rooms DIR] [--runs N] [--window MINUTES] [--variants A,B,...] [--jobs N]
+                      [--first-seed N] [--csv FILE] [-- mission arguments...]
+--runs is the number of seeds per room and variant; arguments after -- go to every mission.
+*/
+
+#include "runner.h"
+#include "work_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+
+struct RunRecord
+{
+	bool ok;
+	double coverage, t90, redundant, collisions;
+};
+
+/**
+ * @brief Summary of a sample: mean with a normal 95% interval and a few percentiles
+ */
+struct Distribution
+{
+	explicit Distribution(std::vector<double> values) : n(values.size()), mean(0), ci95(0)
+	{
+		std::sort(values.begin(), values.end());
+		for (size_t i = 0; i < n; i++)
+			mean += values[i];
+		mean = n ? mean / n : 0;
+
+		double sq = 0;
+		for (size_t i = 0; i < n; i++)
+			sq += (values[i] - mean) * (values[i] - mean);
+		if (n > 1)
+			ci95 = 1.96 * sqrt(sq / (n - 1)) / sqrt((double)n);
+
+		p10 = percentile(values, 0.1);
+		p50 = percentile(values, 0.5);
+		p90 = percentile(values, 0.9);
+	}
+
+	static double percentile(const std::vector<double> &sorted, double q)
+	{
+		if (sorted.empty())
+			return 0;
+		return sorted[(size_t)(q * (sorted.size() - 1) + 0.5)];
+	}
+
+	size_t n;
+	double mean, ci95, p10, p50, p90;
+};
+
+/**
+ * @brief Wilson score interval for a success proportion
+ */
+static void wilson(int successes, int n, double *low, double *high)
+{
+	const double Z = 1.96;
+	if (n == 0)
+	{
+		*low = *high = 0;
+		return;
+	}
+	double p = (double)successes / n;
+	double centre = (p + Z * Z / (2 * n)) / (1 + Z * Z / n);
+	double half = Z * sqrt(p * (1 - p) / n + Z * Z / (4.0 * n * n)) / (1 + Z * Z / n);
+	*low = std::max(0.0, centre - half);
+	*high = std::min(1.0, centre + half);
+}
+
+static int usage(const char *argv0)
+{
+	fprintf(stderr, "usage: %s [--rooms DIR] [--runs N] [--window MINUTES] [--variants A,B,...] [--jobs N]\n"
+					"       [--first-seed N] [--csv FILE] [-- mission arguments...]\n", argv0);
+	return 2;
+}
+
+int main(int argc, char **argv)
+{
+	std::string binDir = executableDir(argv[0]);
+	std::string roomDir = binDir + "/../rooms";
+	std::vector<std::string> variants = allVariants();
+	std::vector<std::string> missionArgs;
+	int runs = 100, window = 5, jobs = 0;
+	unsigned firstSeed = 1;
+	const char *csvPath = NULL;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--")
+		{
+			missionArgs.assign(argv + i + 1, argv + argc);
+			break;
+		}
+		else if (arg == "--rooms" && hasValue)
+			roomDir = argv[++i];
+		else if (arg == "--runs" && hasValue)
+			runs = atoi(argv[++i]);
+		else if (arg == "--window" && hasValue)
+			window = atoi(argv[++i]);
+		else if (arg == "--jobs" && hasValue)
+			jobs = atoi(argv[++i]);
+		else if (arg == "--first-seed" && hasValue)
+			firstSeed = strtoul(argv[++i], NULL, 10);
+		else if (arg == "--csv" && hasValue)
+			csvPath = argv[++i];
+		else if (arg == "--variants" && hasValue)
+		{
+			variants.clear();
+			std::istringstream list(argv[++i]);
+			std::string name;
+			while (std::getline(list, name, ','))
+				variants.push_back(name);
+		}
+		else
+			return usage(argv[0]);
+	}
+
+	std::vector<std::string> rooms = listRooms(roomDir);
+	if (rooms.empty())
+	{
+		fprintf(stderr, "no rooms in %s\n", roomDir.c_str());
+		return 2;
+	}
+
+	// the duration prompt treats Enter like Down, so enter one minute more than the window
+	std::vector<MissionJob> batch;
+	for (size_t v = 0; v < variants.size(); v++)
+	{
+		for (size_t r = 0; r < rooms.size(); r++)
+		{
+			for (int s = 0; s < runs; s++)
+			{
+				MissionJob job = {variants[v], rooms[r], firstSeed + s, window + 1, missionArgs};
+				batch.push_back(job);
+			}
+		}
+	}
+
+	WorkStealingPool pool(jobs);
+	std::vector<RunRecord> records(batch.size());
+	std::chrono::steady_clock::time_point wallStart = std::chrono::steady_clock::now();
+
+	pool.run(batch.size(), [&](size_t index) {
+		MissionResult result;
+		RunRecord &record = records[index];
+		record.ok = runMission(binDir, batch[index], &result);
+		record.coverage = result.coverageAt(window * 60);
+		record.t90 = result.number("t90", -1);
+		record.redundant = result.number("redundant_m2", 0);
+		record.collisions = result.number("collisions", 0);
+	});
+
+	double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+	printf("%d missions on %d threads in %.1f s (%.0f missions/s), %d minute window\n\n", (int)batch.size(),
+		   pool.threads(), wallSeconds, batch.size() / wallSeconds, window);
+
+	if (csvPath)
+	{
+		FILE *csv = fopen(csvPath, "w");
+		if (!csv)
+		{
+			fprintf(stderr, "cannot write %s\n", csvPath);
+			return 2;
+		}
+		fprintf(csv, "variant,room,seed,ok,coverage,t90,redundant_m2,collisions\n");
+		for (size_t i = 0; i < batch.size(); i++)
+			fprintf(csv, "%s,%s,%u,%d,%.2f,%.1f,%.2f,%.0f\n", batch[i].variant.c_str(), batch[i].room.c_str(),
+					batch[i].seed, records[i].ok ? 1 : 0, records[i].coverage, records[i].t90, records[i].redundant,
+					records[i].collisions);
+		fclose(csv);
+	}
+
+	printf("%-26s %6s %16s %6s %6s %6s %18s %10s\n", "variant", "runs", "coverage 95% CI", "p10", "p50", "p90",
+		   "P(90% in window)", "collisions");
+	for (size_t v = 0; v < variants.size(); v++)
+	{
+		std::vector<double> coverage, collisions;
+		int reached = 0, failed = 0;
+
+		for (size_t i = 0; i < batch.size(); i++)
+		{
+			if (batch[i].variant != variants[v])
+				continue;
+			if (!records[i].ok)
+			{
+				failed++;
+				continue;
+			}
+			coverage.push_back(records[i].coverage);
+			collisions.push_back(records[i].collisions);
+			if (records[i].t90 >= 0 && records[i].t90 <= window * 60)
+				reached++;
+		}
+
+		Distribution c(coverage), k(collisions);
+		double low, high;
+		wilson(reached, (int)c.n, &low, &high);
+		printf("%-26s %6d %7.1f%% +- %4.1f %5.1f%% %5.1f%% %5.1f%% %6.1f%% [%3.0f-%3.0f] %10.1f%s\n",
+			   variants[v].c_str(), (int)c.n, c.mean, c.ci95, c.p10, c.p50, c.p90,
+			   c.n ? 100.0 * reached / c.n : 0.0, low * 100, high * 100, k.mean,
+			   failed ? "  (some runs failed)" : "");
+	}
+
+	printf("\nmean coverage by room, %% +- 95%% CI\n%-26s", "variant");
+	for (size_t r = 0; r < rooms.size(); r++)
+	{
+		std::string name = rooms[r].substr(rooms[r].rfind('/') + 1);
+		printf(" %14s", name.substr(0, name.size() - 5).c_str());
+	}
+	printf("\n");
+	for (size_t v = 0; v < variants.size(); v++)
+	{
+		printf("%-26s", variants[v].c_str());
+		for (size_t r = 0; r < rooms.size(); r++)
+		{
+			std::vector<double> coverage;
+			for (size_t i = 0; i < batch.size(); i++)
+				if (batch[i].variant == variants[v] && batch[i].room == rooms[r] && records[i].ok)
+					coverage.push_back(records[i].coverage);
+			Distribution c(coverage);
+			printf("    %5.1f +- %3.1f", c.mean, c.ci95);
+		}
+		printf("\n");
+	}
+	return 0;
+}
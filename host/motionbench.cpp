@@ -0,0 +1,610 @@
+/*
+Motion benchmark
+Description: Runs For_Report-Tape's own motion functions on an empty floor in the room simulator and
+measures how well they move the robot. The mission is linked in as it is built for bin/For_Report-Tape
+and its functions are called directly, after configureAllSensors() and startSensorTask() as in its
+task main.
+
+Straight: driveDistance() over --distance cm at FWD_SPEED with the mission's heading hold off and on, for
+each wheel mismatch (SimConfig::motorMismatch) given, reporting how far the robot ended up to the side
+of the line it started on, the furthest it strayed, the heading it finished on and the distance it
+covered along the line.
+
+Moves: the short driveDistance() moves of sweepEdge's corners, run the old way (full FWD_SPEED
+power, cut at the distance) and profiled at FWD_SPEED and at CORNER_SPEED, reporting where the robot
+came to rest against the distance asked for and how long the call took.
+
+Turns: smartRotateRobot() on the spot and the wide turns of the corners on one wheel, at the old
+TURN_SPEED and profiled, reporting the angle the robot came to rest at against the angle asked for and
+how long the call took.
+
+Pose: laps of a 1 m square (driveDistance() and smartRotateRobot() as the mission makes them), with and
+without gyro drift, comparing UW_pose.c's estimate with where the simulated robot really is.
+
+Rooms: sweepEdge() and --minutes of randomClean() in each room given, with the gyro drifting
+--drift degrees a minute and the Manhattan correction (UW_manhattan.c) off and on, reporting how far
+the pose estimate strays from the truth over --seeds runs with rand() seeded 1, 2, ... With --max-error,
+the bench fails if the estimate with the correction on strayed further than CM in any room.
+
+Map: the same runs without drift and with the drum turning, comparing the coverage UW_coverageMap.c
+reports, of the floor found and of the room's outline, with the simulator's (coverage.h), and the floor
+the map has found with the room's. With --max-gap, the bench fails if the map's own coverage is more
+than PCT points off the simulator's in any room.
+
+Usage: bin/motionbench [--distance CM] [--mismatch F,F,...] [--rooms FILE,FILE,...] [--minutes N]
+                       [--drift DEG_PER_MIN] [--seeds N] [--max-error CM] [--max-gap PCT]
+*/
+
+#include "coverage.h"
+#include "smux_device.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// For_Report-Tape.c, compiled as C++ behind the HAL
+void configureAllSensors();
+void startSensorTask(tSensors ultrasonic, tSensors gyro, tSensors colour);
+void startPoseTask(tMotor left, tMotor right, float cmPerDegree);
+void startManhattan(float front, float side);
+void sweepEdge(int edges, int tapeColour);
+void randomClean(float duration, int target, bool explore, int tapeColour);
+extern bool manhattanEnabled;
+void startCoverageMap(tMotor drum, float drumWidth, float drumDepth, float sensorOffset);
+float getCoverage();
+float getRoomCoverage();
+extern long mapKnownCells;
+void drive(int mPower);
+void driveDistance(int distance, int mPower);
+bool smartRotateRobot(int angle, int tapeColour);
+void rotateRobotWide(int angle);
+void rotateRobotBackwardsWide(int angle);
+extern bool headingHold;
+extern bool motionProfile;
+extern bool turnProfile;
+
+// layout of UW_pose.c's tPose
+typedef struct
+{
+	long timestamp;
+	float x;
+	float y;
+	float heading;
+	float distance;
+} tPose;
+
+void getPose(tPose &pose);
+
+const int FWD_SPEED = 30;
+const int RADIUS = 4;
+const int BUMPER_OFFSET = 12;
+const int ULTRASONIC_OFFSET = 12;
+const int DRUM_WIDTH = 20;
+const int DRUM_DEPTH = 4;
+const int MAP_CELL = 5;
+const int DRUM_SPRAY_SPEED = 60;
+const int CORNER_SPEED = 60;
+const int MOVES[] = {5, 10, -5, -15, 50};
+
+enum TurnKind
+{
+	kSpin,
+	kWide,
+	kBackwardsWide
+};
+
+struct Turn
+{
+	TurnKind kind;
+	int angle;
+};
+
+// randomClean's turns on the spot, then the corners' wide turns
+const Turn TURNS[] = {{kSpin, 90},			{kSpin, -90},		  {kSpin, 135},			{kSpin, 180},
+					  {kSpin, 270},			{kWide, 90},		  {kWide, -90},			{kBackwardsWide, 45},
+					  {kBackwardsWide, -45}};
+const char *TURN_NAMES[] = {"spin", "wide", "back wide"};
+
+/**
+ * @brief Records the furthest the robot strays from the x axis
+ */
+class LateralTrace : public HalTicker
+{
+public:
+	LateralTrace(const RoomSim &sim) : sim_(sim), worst_(0) {}
+
+	void tick(long long nowUs)
+	{
+		if (fabs(sim_.pose().y) > worst_)
+			worst_ = fabs(sim_.pose().y);
+	}
+
+	double worst() const { return worst_; }
+
+private:
+	const RoomSim &sim_;
+	double worst_;
+};
+
+struct StraightResult
+{
+	double lateral, worst, heading, along, seconds;
+};
+
+/**
+ * @brief A room, by default an empty floor with the robot at the origin facing along the x axis, and the
+ * mission set up in it as task main does
+ */
+class Floor
+{
+public:
+	Floor(const SimConfig &config, const Room &room = Room())
+		: room_(room), config_(config), sim_(room_, config_), smux_(sim_, SmuxTiming(), 1)
+	{
+		halReset();
+		halSetWorld(&sim_);
+		halAttachI2C(S4, &smux_);
+		halAddTicker(&smux_);
+
+		configureAllSensors();
+		halMissionStarted();
+		startSensorTask(S1, S2, S3);
+		startPoseTask(motorA, motorD, -RADIUS * PI / 180);
+		startManhattan(BUMPER_OFFSET, ULTRASONIC_OFFSET);
+		startCoverageMap(motorB, DRUM_WIDTH, DRUM_DEPTH, ULTRASONIC_OFFSET);
+
+		// the mission's globals outlive a floor, so its heading hold has to start from a stop
+		drive(0);
+	}
+
+	const RoomSim &sim() const { return sim_; }
+
+private:
+	Room room_;
+	SimConfig config_;
+	RoomSim sim_;
+	SmuxDevice smux_;
+};
+
+/**
+ * @brief Drive distance cm along the x axis
+ */
+static StraightResult straight(double mismatch, bool hold, int distance)
+{
+	SimConfig config;
+	config.motorMismatch = mismatch;
+	Floor floor(config);
+	const RoomSim &sim = floor.sim();
+	LateralTrace trace(sim);
+	halAddTicker(&trace);
+	headingHold = hold;
+	motionProfile = true;
+
+	long long startUs = halNowUs();
+	driveDistance(distance, FWD_SPEED);
+	sleep(500); // let the robot roll to a stop
+
+	StraightResult result;
+	result.lateral = sim.pose().y;
+	result.worst = trace.worst();
+	result.heading = sim.pose().heading;
+	result.along = sim.pose().x;
+	result.seconds = (halNowUs() - startUs) / 1e6;
+	return result;
+}
+
+struct MoveResult
+{
+	double error, seconds;
+};
+
+/**
+ * @brief One driveDistance() move, with the heading hold on
+ *
+ * @return how far from distance the robot came to rest, positive past it, and the time the call took
+ */
+static MoveResult move(int distance, int power, bool profile)
+{
+	SimConfig config;
+	Floor floor(config);
+	headingHold = true;
+	motionProfile = profile;
+
+	long long startUs = halNowUs();
+	driveDistance(distance, power);
+	MoveResult result;
+	result.seconds = (halNowUs() - startUs) / 1e6;
+	sleep(500);
+	result.error = (floor.sim().pose().x - distance) * (distance > 0 ? 1 : -1);
+	return result;
+}
+
+/**
+ * @brief One turn, as the mission makes it
+ *
+ * @return how far past the angle the robot came to rest, in degrees, and the time the call took
+ */
+static MoveResult turn(const Turn &t, bool profile)
+{
+	SimConfig config;
+	Floor floor(config);
+	turnProfile = profile;
+
+	long long startUs = halNowUs();
+	if (t.kind == kSpin)
+		smartRotateRobot(t.angle, -1);
+	else if (t.kind == kWide)
+		rotateRobotWide(t.angle);
+	else
+		rotateRobotBackwardsWide(t.angle);
+	MoveResult result;
+	result.seconds = (halNowUs() - startUs) / 1e6;
+	sleep(500);
+	result.error = fabs(floor.sim().pose().heading) - abs(t.angle);
+	return result;
+}
+
+struct PoseResult
+{
+	double position, heading, minutes;
+};
+
+/**
+ * @brief Drive laps of a 1 m square turning left at the corners
+ *
+ * @return how far the pose estimate is from the robot's true position and heading at the end
+ */
+static PoseResult laps(int count, double driftPerMin)
+{
+	SimConfig config;
+	config.gyroDriftPerMin = driftPerMin;
+	Floor floor(config);
+
+	for (int lap = 0; lap < count; lap++)
+	{
+		for (int side = 0; side < 4; side++)
+		{
+			driveDistance(100, FWD_SPEED);
+			smartRotateRobot(-90, -1);
+		}
+	}
+	sleep(500);
+
+	tPose pose;
+	getPose(pose);
+	const SimPose &truth = floor.sim().pose();
+	PoseResult result;
+	result.position = hypot(pose.x - truth.x, pose.y - truth.y);
+	result.heading = pose.heading - truth.heading;
+	result.minutes = halNowUs() / 60e6;
+	return result;
+}
+
+/**
+ * @brief Samples how far the mission's pose estimate is from the truth, once a second
+ */
+class PoseError : public HalTicker
+{
+public:
+	PoseError(const RoomSim &sim) : sim_(sim), nextUs_(0), worst_(0), worstHeading_(0), total_(0), samples_(0) {}
+
+	void tick(long long nowUs)
+	{
+		if (nowUs < nextUs_)
+			return;
+		nextUs_ = nowUs + 1000000;
+
+		// the mission's frame starts at the room's start pose
+		const Room &room = sim_.room();
+		const SimPose &truth = sim_.pose();
+		double a = -room.startHeading * PI / 180;
+		double dx = truth.x - room.start.x, dy = truth.y - room.start.y;
+		double x = dx * cos(a) - dy * sin(a), y = dx * sin(a) + dy * cos(a);
+
+		tPose pose;
+		getPose(pose);
+		double error = hypot(pose.x - x, pose.y - y);
+		double heading = fabs(pose.heading - (truth.heading - room.startHeading));
+		worst_ = std::max(worst_, error);
+		worstHeading_ = std::max(worstHeading_, heading);
+		total_ += error;
+		samples_++;
+		last_ = error;
+		lastHeading_ = heading;
+	}
+
+	double worst() const { return worst_; }
+	double worstHeading() const { return worstHeading_; }
+	double mean() const { return samples_ ? total_ / samples_ : 0; }
+	double last() const { return last_; }
+	double lastHeading() const { return lastHeading_; }
+
+private:
+	const RoomSim &sim_;
+	long long nextUs_;
+	double worst_, worstHeading_, total_, last_, lastHeading_;
+	long samples_;
+};
+
+/**
+ * @brief Clean a room the way task main does, after the startup menus, once for each seed of rand()
+ *
+ * Prints the mean error over the seeds, the worst of them and the mean of where they ended.
+ * @return the worst error, cm
+ */
+static double cleanRoom(const Room &room, double minutes, double driftPerMin, bool manhattan, int seeds)
+{
+	double mean = 0, worst = 0, last = 0, worstHeading = 0, lastHeading = 0;
+	for (int seed = 1; seed <= seeds; seed++)
+	{
+		SimConfig config;
+		config.gyroDriftPerMin = driftPerMin;
+		Floor floor(config, room);
+		PoseError error(floor.sim());
+		halAddTicker(&error);
+		manhattanEnabled = manhattan;
+		srand(seed);
+
+		time100[T1] = 0;
+		sweepEdge(room.edges, room.tapeColour());
+		randomClean(minutes, 0, false, room.tapeColour());
+
+		mean += error.mean() / seeds;
+		worst = std::max(worst, error.worst());
+		last += error.last() / seeds;
+		worstHeading = std::max(worstHeading, error.worstHeading());
+		lastHeading += error.lastHeading() / seeds;
+	}
+
+	printf("%-16s %-9s %10.1f %10.1f %10.1f %12.1f %12.1f\n", room.name.c_str(), manhattan ? "on" : "off", mean,
+		   worst, last, worstHeading, lastHeading);
+	return worst;
+}
+
+/**
+ * @brief Cleanable floor of a room in square metres, counted in map cells
+ */
+static double floorArea(const Room &room)
+{
+	long cells = 0;
+	for (double y = room.lower.y + MAP_CELL / 2.0; y < room.upper.y; y += MAP_CELL)
+		for (double x = room.lower.x + MAP_CELL / 2.0; x < room.upper.x; x += MAP_CELL)
+			cells += room.isFree(Vec2{x, y});
+	return cells * MAP_CELL * MAP_CELL / 1e4;
+}
+
+/**
+ * @brief Clean a room as task main does, drum and all, comparing the coverage map with the truth
+ *
+ * Prints the means over the seeds.
+ * @return how far the map's coverage is from the truth, percentage points
+ */
+static double mapRoom(const Room &room, double minutes, int seeds)
+{
+	double mapped = 0, outlined = 0, truth = 0, found = 0;
+	for (int seed = 1; seed <= seeds; seed++)
+	{
+		Floor floor(SimConfig(), room);
+		CoverageGrid coverage(floor.sim(), 60);
+		halAddTicker(&coverage);
+		manhattanEnabled = true;
+		srand(seed);
+
+		time100[T1] = 0;
+		motor[motorB] = DRUM_SPRAY_SPEED;
+		sweepEdge(room.edges, room.tapeColour());
+		randomClean(minutes, 0, false, room.tapeColour());
+		motor[motorB] = 0;
+
+		mapped += getCoverage() / seeds;
+		outlined += getRoomCoverage() / seeds;
+		truth += 100 * coverage.coverage() / seeds;
+		found += mapKnownCells * MAP_CELL * MAP_CELL / 1e4 / seeds;
+	}
+
+	printf("%-16s %10.1f %10.1f %10.1f %12.1f %12.1f\n", room.name.c_str(), mapped, outlined, truth, found,
+		   floorArea(room));
+	return fabs(mapped - truth);
+}
+
+static int usage(const char *argv0)
+{
+	fprintf(stderr, "usage: %s [--distance CM] [--mismatch F,F,...] [--rooms FILE,FILE,...] [--minutes N]\n"
+					"       [--drift DEG_PER_MIN] [--seeds N] [--max-error CM] [--max-gap PCT]\n", argv0);
+	return 2;
+}
+
+int main(int argc, char **argv)
+{
+	int distance = 200;
+	int seeds = 3;
+	double minutes = 20, drift = 1;
+	double maxError = 0, maxGap = 0;
+	std::vector<double> mismatches;
+	std::vector<std::string> roomPaths;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--distance" && hasValue)
+			distance = atoi(argv[++i]);
+		else if (arg == "--mismatch" && hasValue)
+		{
+			std::istringstream list(argv[++i]);
+			std::string item;
+			while (std::getline(list, item, ','))
+				mismatches.push_back(atof(item.c_str()));
+		}
+		else if (arg == "--rooms" && hasValue)
+		{
+			std::istringstream list(argv[++i]);
+			std::string item;
+			while (std::getline(list, item, ','))
+				roomPaths.push_back(item);
+		}
+		else if (arg == "--minutes" && hasValue)
+			minutes = atof(argv[++i]);
+		else if (arg == "--drift" && hasValue)
+			drift = atof(argv[++i]);
+		else if (arg == "--seeds" && hasValue)
+			seeds = atoi(argv[++i]);
+		else if (arg == "--max-error" && hasValue)
+			maxError = atof(argv[++i]);
+		else if (arg == "--max-gap" && hasValue)
+			maxGap = atof(argv[++i]);
+		else
+			return usage(argv[0]);
+	}
+	if (roomPaths.empty())
+	{
+		const char *slash = strrchr(argv[0], '/');
+		std::string rooms = (slash ? std::string(argv[0], slash - argv[0]) : ".") + "/../rooms/";
+		roomPaths.push_back(rooms + "square.room");
+		roomPaths.push_back(rooms + "lshape.room");
+		roomPaths.push_back(rooms + "obstacles.room");
+	}
+	if (distance <= 0 || seeds <= 0)
+		return usage(argv[0]);
+	if (mismatches.empty())
+	{
+		mismatches.push_back(0);
+		mismatches.push_back(0.01);
+		mismatches.push_back(0.03);
+		mismatches.push_back(0.05);
+	}
+
+	printf("straight: driveDistance(%d, %d) on an empty floor\n\n", distance, FWD_SPEED);
+	printf("%-9s %-5s %12s %12s %12s %10s %8s\n", "mismatch", "hold", "lateral cm", "worst cm", "heading deg",
+		   "along cm", "time s");
+	for (size_t m = 0; m < mismatches.size(); m++)
+	{
+		for (int hold = 0; hold < 2; hold++)
+		{
+			StraightResult r = straight(mismatches[m], hold, distance);
+			printf("%-9.3f %-5s %12.2f %12.2f %12.2f %10.1f %8.2f\n", mismatches[m], hold ? "on" : "off", r.lateral,
+				   r.worst, r.heading, r.along, r.seconds);
+		}
+	}
+
+	const int numbOfMoves = sizeof(MOVES) / sizeof(MOVES[0]);
+	const int powers[3] = {FWD_SPEED, FWD_SPEED, CORNER_SPEED};
+	const bool profiles[3] = {false, true, true};
+	double totalError[3] = {0, 0, 0}, totalSeconds[3] = {0, 0, 0};
+
+	printf("\nmoves: where driveDistance() came to rest (cm past the distance) and how long it took (s)\n\n");
+	printf("%-9s %18s %18s %18s\n", "distance", "full power 30", "profiled 30", "profiled 60");
+	for (int i = 0; i < numbOfMoves; i++)
+	{
+		printf("%-9d", MOVES[i]);
+		for (int c = 0; c < 3; c++)
+		{
+			MoveResult r = move(MOVES[i], powers[c], profiles[c]);
+			totalError[c] += fabs(r.error);
+			totalSeconds[c] += r.seconds;
+			printf("     %+6.2f %6.2fs", r.error, r.seconds);
+		}
+		printf("\n");
+	}
+	printf("%-9s", "mean |err|");
+	for (int c = 0; c < 3; c++)
+		printf("     %6.2f %6.2fs", totalError[c] / numbOfMoves, totalSeconds[c]);
+	printf("\n");
+
+	const int numbOfTurns = sizeof(TURNS) / sizeof(TURNS[0]);
+	double turnError[2] = {0, 0}, worstError[2] = {0, 0}, turnSeconds[2] = {0, 0};
+
+	printf("\nturns: where the turn came to rest (degrees past the angle) and how long it took (s)\n\n");
+	printf("%-10s %6s %18s %18s\n", "turn", "angle", "TURN_SPEED", "profiled");
+	for (int i = 0; i < numbOfTurns; i++)
+	{
+		printf("%-10s %6d", TURN_NAMES[TURNS[i].kind], TURNS[i].angle);
+		for (int c = 0; c < 2; c++)
+		{
+			MoveResult r = turn(TURNS[i], c == 1);
+			turnError[c] += fabs(r.error);
+			if (fabs(r.error) > worstError[c])
+				worstError[c] = fabs(r.error);
+			turnSeconds[c] += r.seconds;
+			printf("     %+6.2f %6.2fs", r.error, r.seconds);
+		}
+		printf("\n");
+	}
+	printf("%-17s", "mean |err|");
+	for (int c = 0; c < 2; c++)
+		printf("     %6.2f %6.2fs", turnError[c] / numbOfTurns, turnSeconds[c]);
+	printf("\n%-17s", "worst |err|");
+	for (int c = 0; c < 2; c++)
+		printf("     %6.2f        ", worstError[c]);
+	printf("\n");
+
+	const int LAPS[] = {1, 5, 20};
+	const double DRIFTS[] = {0, 1};
+	printf("\npose: UW_pose.c's estimate against the truth after laps of a 1 m square\n\n");
+	printf("%-5s %12s %10s %14s %14s\n", "laps", "drift/min", "minutes", "position cm", "heading deg");
+	for (int d = 0; d < 2; d++)
+	{
+		for (int l = 0; l < 3; l++)
+		{
+			PoseResult r = laps(LAPS[l], DRIFTS[d]);
+			printf("%-5d %12.1f %10.1f %14.2f %+14.2f\n", LAPS[l], DRIFTS[d], r.minutes, r.position, r.heading);
+		}
+	}
+
+	printf("\nrooms: pose error over sweepEdge and %.0f minutes of randomClean, gyro drift %.1f deg/min, %d seeds\n\n",
+		   minutes, drift, seeds);
+	printf("%-16s %-9s %10s %10s %10s %12s %12s\n", "room", "manhattan", "mean cm", "worst cm", "end cm",
+		   "worst deg", "end deg");
+	std::vector<Room> rooms;
+	std::vector<std::string> failures;
+	for (size_t r = 0; r < roomPaths.size(); r++)
+	{
+		Room room;
+		std::string error;
+		if (!room.load(roomPaths[r].c_str(), &error))
+		{
+			fprintf(stderr, "%s\n", error.c_str());
+			return 2;
+		}
+		for (int manhattan = 0; manhattan < 2; manhattan++)
+		{
+			double worst = cleanRoom(room, minutes, drift, manhattan, seeds);
+			if (manhattan && maxError > 0 && worst > maxError)
+			{
+				char failure[128];
+				snprintf(failure, sizeof failure, "%s: pose %.1f cm off with the correction on, over %.1f",
+						 room.name.c_str(), worst, maxError);
+				failures.push_back(failure);
+			}
+		}
+		rooms.push_back(room);
+	}
+
+	printf("\nmap: coverage map against the truth after sweepEdge and %.0f minutes of randomClean, %d seeds\n\n",
+		   minutes, seeds);
+	printf("%-16s %10s %10s %10s %12s %12s\n", "room", "map %", "room %", "true %", "found m2", "floor m2");
+	for (size_t r = 0; r < rooms.size(); r++)
+	{
+		double gap = mapRoom(rooms[r], minutes, seeds);
+		if (maxGap > 0 && gap > maxGap)
+		{
+			char failure[128];
+			snprintf(failure, sizeof failure, "%s: map coverage %.1f points off the truth, over %.1f",
+					 rooms[r].name.c_str(), gap, maxGap);
+			failures.push_back(failure);
+		}
+	}
+
+	if (maxError > 0 || maxGap > 0)
+		printf("\n");
+	for (size_t f = 0; f < failures.size(); f++)
+		printf("FAIL %s\n", failures[f].c_str());
+	if (failures.empty() && maxError > 0)
+		printf("PASS pose within %.1f cm with the correction on in every room\n", maxError);
+	if (failures.empty() && maxGap > 0)
+		printf("PASS map coverage within %.1f points of the truth in every room\n", maxGap);
+	return failures.empty() ? 0 : 1;
+}
@@ -0,0 +1,140 @@
+/*
+SMUX read cost benchmark
+Description: Times the generic readMuxSensor() against the mode-specialised readers of UW_sensorMux.c
+(readMuxTouch() and friends) on the host. The simulated SMUX answers every transaction instantly, so
+only the CPU cost of the read path is measured: the RobotC code and the HAL intrinsics it calls. The
+channel's read transaction on its own is timed as well; what a path costs on top of it is the work spent
+on the request and on decoding the reply. The port check writeI2C() used to run on every transaction is
+timed in front of a bare transaction for comparison.
+
+Usage: bin/muxbench [--reads N] [--repeats N]
+--reads is the number of reads of each of the three channels per timing, --repeats the number of
+timings per path, of which the fastest is reported. The paths take turns so that they all see the same
+machine load.
+*/
+
+#include "smux_device.h"
+
+#include <UW_sensorMux.c>
+
+#include <cstdio>
+#include <ctime>
+
+const tMUXSensor CHANNELS[3] = {msensor_S4_1, msensor_S4_2, msensor_S4_3};
+const tEV3SensorTypeMode MODES[3] = {touchStateBump, sonarCM, gyroAngle};
+
+enum ReadPath
+{
+	kBusOnly,
+	kChecked,
+	kGeneric,
+	kSpecialised,
+	kNumbOfReadPaths
+};
+
+const char *PATH_NAMES[kNumbOfReadPaths] = {"transaction only", "checked", "readMuxSensor", "specialised"};
+
+/**
+ * @brief Read every channel reads times along one path
+ *
+ * @return sum of the readings, so the reads cannot be optimised away
+ */
+static long readChannels(ReadPath path, long reads)
+{
+	long sum = 0;
+	for (long i = 0; i < reads; i++)
+	{
+		switch (path)
+		{
+		case kBusOnly:
+			for (int c = 0; c < 3; c++)
+				sum += transactI2C(&muxedSensor[c]._read, &muxedSensor[c].I2CData.reply[0]);
+			break;
+
+		case kChecked:
+			for (int c = 0; c < 3; c++)
+				sum += checkI2CPort(muxedSensor[c].I2CData.port) &&
+					   transactI2C(&muxedSensor[c]._read, &muxedSensor[c].I2CData.reply[0]);
+			break;
+
+		case kGeneric:
+			for (int c = 0; c < 3; c++)
+				sum += readMuxSensor(CHANNELS[c]);
+			break;
+
+		default:
+			sum += readMuxTouch(CHANNELS[0]);
+			sum += readMuxSonar(CHANNELS[1]);
+			sum += readMuxGyroAngle(CHANNELS[2]);
+			break;
+		}
+	}
+	return sum;
+}
+
+static int usage(const char *argv0)
+{
+	fprintf(stderr, "usage: %s [--reads N] [--repeats N]\n", argv0);
+	return 2;
+}
+
+int main(int argc, char **argv)
+{
+	long reads = 100000;
+	int repeats = 61;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--reads" && hasValue)
+			reads = atol(argv[++i]);
+		else if (arg == "--repeats" && hasValue)
+			repeats = atoi(argv[++i]);
+		else
+			return usage(argv[0]);
+	}
+	if (reads <= 0 || repeats <= 0)
+		return usage(argv[0]);
+
+	// an empty room and a bus that takes no time, so that nothing but the read path is timed
+	Room room;
+	SimConfig config;
+	RoomSim sim(room, config);
+	SmuxTiming timing;
+	timing.setupUs = timing.byteUs = timing.jitterUs = timing.pendingUs = 0;
+	SmuxDevice smux(sim, timing, 1);
+	halAttachI2C(S4, &smux);
+
+	SensorType[S4] = sensorEV3_GenericI2C;
+	for (int c = 0; c < 3; c++)
+	{
+		if (!initSensorMux(CHANNELS[c], MODES[c]))
+		{
+			fprintf(stderr, "cannot set up SMUX channel %d\n", c + 1);
+			return 1;
+		}
+	}
+
+	double nsPerRead[kNumbOfReadPaths];
+	long checksum = 0;
+	for (int r = 0; r < repeats; r++)
+	{
+		for (int path = 0; path < kNumbOfReadPaths; path++)
+		{
+			std::clock_t start = std::clock();
+			checksum += readChannels((ReadPath)path, reads);
+			double ns = (std::clock() - start) * 1e9 / CLOCKS_PER_SEC / (reads * 3);
+			if (r == 0 || ns < nsPerRead[path])
+				nsPerRead[path] = ns;
+		}
+	}
+
+	printf("%ld reads of each channel (touch, sonar, gyro angle), fastest of %d timings\n\n", reads, repeats);
+	printf("%-16s %12s %18s\n", "path", "ns per read", "on top of the bus");
+	for (int path = 0; path < kNumbOfReadPaths; path++)
+		printf("%-16s %12.1f %18.1f\n", PATH_NAMES[path], nsPerRead[path], nsPerRead[path] - nsPerRead[kBusOnly]);
+	printf("\nchecksum %ld, %ld simulated transactions\n", checksum, smux.transactions());
+	return 0;
+}
@@ -0,0 +1,117 @@
+#include "operator.h"
+
+#include <cstdio>
+
+// how long a button is held, and how long the operator waits before reading the display again
+const long long PRESS_US = 250000, SETTLE_US = 200000;
+
+HalOperator::HalOperator(int edges, int minutes, int tapeColour, int target, const std::string &mode)
+	: edges_(edges), minutes_(minutes), tapeColour_(tapeColour), target_(target), mode_(mode), held_(buttonNone),
+	  releaseAtUs_(0), idleUntilUs_(0), starting_(false), accepting_(false)
+{
+}
+
+void HalOperator::press(TEV3Buttons button, long long nowUs)
+{
+	held_ = button;
+	halSetButton(button, true);
+	releaseAtUs_ = nowUs + PRESS_US;
+}
+
+/**
+ * @brief Look for a prompt on the display
+ *
+ * @param prompt text to look for
+ * @param value if not NULL, receives the number printed after the prompt
+ * @return true if the prompt is on screen
+ */
+bool HalOperator::findLine(const char *prompt, int *value)
+{
+	for (int line = 0; line < kNumbOfDisplayLines; line++)
+	{
+		const char *text = strstr(halDisplayLine(line), prompt);
+		if (!text)
+			continue;
+		if (!value)
+			return true;
+		return sscanf(text + strlen(prompt), "%d", value) == 1;
+	}
+	return false;
+}
+
+void HalOperator::tick(long long nowUs)
+{
+	int value = 0;
+
+	if (held_ != buttonNone)
+	{
+		if (nowUs < releaseAtUs_)
+			return;
+		halSetButton(held_, false);
+		held_ = buttonNone;
+		idleUntilUs_ = nowUs + SETTLE_US;
+
+		if (accepting_)
+			halSetColorOverride(-1);
+		if (starting_)
+			halMissionStarted();
+		accepting_ = starting_ = false;
+		return;
+	}
+
+	if (nowUs < idleUntilUs_ || halMissionStartUs() >= 0)
+		return;
+
+	// hold the robot over the tape until the colour has been accepted
+	if (findLine("Place Robot on coloured tape", NULL))
+		halSetColorOverride(tapeColour_);
+
+	if (findLine("Accept or retry?", NULL))
+	{
+		accepting_ = true;
+		press(buttonUp, nowUs);
+	}
+	else if (findLine("Number of edges: ", &value))
+	{
+		if (value < edges_)
+			press(buttonUp, nowUs);
+		else if (value > edges_)
+			press(buttonDown, nowUs);
+		else
+			press(buttonEnter, nowUs);
+	}
+	else if (findLine("Duration: ", &value))
+	{
+		if (value < minutes_)
+			press(buttonUp, nowUs);
+		else if (value > minutes_)
+			press(buttonDown, nowUs);
+		else
+			press(buttonEnter, nowUs);
+	}
+	else if (findLine("Target coverage: ", NULL))
+	{
+		// no target reads "none"
+		value = 0;
+		findLine("Target coverage: ", &value);
+		if (value < target_)
+			press(buttonUp, nowUs);
+		else if (value > target_)
+			press(buttonDown, nowUs);
+		else
+			press(buttonEnter, nowUs);
+	}
+	else if (findLine("Cleaning mode: ", NULL))
+	{
+		// step through the modes until the one asked for is on screen
+		if (findLine(("Cleaning mode: " + mode_).c_str(), NULL))
+			press(buttonEnter, nowUs);
+		else
+			press(buttonUp, nowUs);
+	}
+	else if (findLine("enter to start.", NULL))
+	{
+		starting_ = true;
+		press(buttonEnter, nowUs);
+	}
+}
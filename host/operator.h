@@ -0,0 +1,44 @@
+/*
+Scripted operator for the host HAL
+Description: Plays the part of the person at the robot during startup. It reads the prompts on the
+virtual display and presses buttons the way a user following the instructions would: shows the robot
+the tape colour, steps the edge count, duration, target coverage and cleaning mode to the requested
+values and presses
+enter to start.
+*/
+
+#ifndef __OPERATOR_H__
+#define __OPERATOR_H__
+
+#include "robotc_hal.h"
+
+#include <string>
+
+class HalOperator : public HalTicker
+{
+public:
+	/**
+	 * @brief Create an operator that answers the startup prompts
+	 *
+	 * @param edges number of edges to enter
+	 * @param minutes cleaning duration to enter
+	 * @param tapeColour colour shown to the robot when it asks for the tape
+	 * @param target coverage to stop at, percent, 0 for none, for missions that ask
+	 * @param mode cleaning mode to pick, as the mission names it, for missions that ask
+	 */
+	HalOperator(int edges, int minutes, int tapeColour, int target, const std::string &mode);
+
+	void tick(long long nowUs);
+
+private:
+	void press(TEV3Buttons button, long long nowUs);
+	bool findLine(const char *prompt, int *value);
+
+	int edges_, minutes_, tapeColour_, target_;
+	std::string mode_;
+	TEV3Buttons held_;
+	long long releaseAtUs_, idleUntilUs_;
+	bool starting_, accepting_;
+};
+
+#endif // __OPERATOR_H__
@@ -0,0 +1,191 @@
+#include "replay.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+const int RECORDER_HEADER_BYTES = 8;
+const int RECORDER_VERSION = 3;
+const int REC_DROPPED = 255;
+const ubyte SMUX_ADDRESSES[3] = {0xA0, 0xA2, 0xA4};
+const ubyte SMUX_DATA_REG = 0x54;
+
+/**
+ * @brief Little endian signed value of length bytes
+ */
+static long field(const ubyte *bytes, int length)
+{
+	unsigned long value = 0;
+	for (int i = 0; i < length; i++)
+		value |= (unsigned long)bytes[i] << (8 * i);
+
+	unsigned long sign = 1UL << (8 * length - 1);
+	return (long)((value ^ sign) - sign);
+}
+
+/**
+ * @brief Bytes of a debug stream log's "REC" lines, in order
+ */
+static std::vector<ubyte> hexLines(const std::string &text)
+{
+	std::vector<ubyte> bytes;
+	std::istringstream lines(text);
+	std::string line;
+
+	while (std::getline(lines, line))
+	{
+		size_t tag = line.find("REC");
+		if (tag == std::string::npos)
+			continue;
+		std::istringstream hex(line.substr(tag + 3));
+		std::string byte;
+		while (hex >> byte)
+			bytes.push_back((ubyte)strtoul(byte.c_str(), NULL, 16));
+	}
+	return bytes;
+}
+
+bool Recording::load(const std::string &path, std::string *error)
+{
+	std::ifstream in(path.c_str(), std::ios::binary);
+	if (!in)
+	{
+		*error = "cannot read " + path;
+		return false;
+	}
+	std::string contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+	std::vector<ubyte> bytes;
+	if (contents.compare(0, 4, "UWRC") == 0)
+		bytes.assign(contents.begin(), contents.end());
+	else
+		bytes = hexLines(contents);
+
+	if (bytes.size() < (size_t)RECORDER_HEADER_BYTES || memcmp(&bytes[0], "UWRC", 4) != 0)
+	{
+		*error = path + ": no recording found";
+		return false;
+	}
+	const ubyte *header = &bytes[0];
+	int eventBytes = header[5];
+	if (header[4] != RECORDER_VERSION || eventBytes < 8 || field(header + 6, 2) > kNumbOfReplaySources)
+	{
+		*error = path + ": recording version or layout not supported";
+		return false;
+	}
+	events_.clear();
+	dropped_ = 0;
+	for (size_t at = RECORDER_HEADER_BYTES; at + eventBytes <= bytes.size(); at += eventBytes)
+	{
+		const ubyte *e = &bytes[at];
+		if (e[4] == REC_DROPPED)
+		{
+			dropped_ = field(e + 5, 3);
+			break;
+		}
+		ReplayEvent event = {field(e, 4), e[4], field(e + 5, 3)};
+		if (event.source >= kNumbOfReplaySources)
+		{
+			*error = path + ": unknown event source";
+			return false;
+		}
+		events_.push_back(event);
+	}
+	return true;
+}
+
+ReplayInputs::ReplayInputs(const Recording &recording) : replayed_(0)
+{
+	for (size_t i = 0; i < recording.events().size(); i++)
+		events_[recording.events()[i].source].push_back(recording.events()[i]);
+	for (int i = 0; i < kNumbOfReplaySources; i++)
+	{
+		next_[i] = 0;
+		reads_[i] = 0;
+		value_[i] = 0;
+	}
+}
+
+long ReplayInputs::read(HalInput input, int index, long live)
+{
+	switch (input)
+	{
+	case halInputButton:
+		return next(replayButtons + index - buttonUp);
+
+	case halInputSensor:
+		if (SensorType[index] == sensorEV3_Ultrasonic || SensorType[index] == sensorSONAR)
+			return next(replayDistance);
+		if (SensorType[index] == sensorEV3_Color)
+			return next(replayColour);
+		return live;
+
+	case halInputGyroDegrees:
+		return next(replayHeading);
+
+	case halInputGyroRate:
+		return next(replayRate);
+
+	case halInputEncoder:
+		return next(replayEncoders + index);
+
+	case halInputRandom:
+		return next(replayRandom);
+	}
+	return live;
+}
+
+long ReplayInputs::next(int source)
+{
+	const std::vector<ReplayEvent> &events = events_[source];
+	long read = ++reads_[source];
+
+	for (; next_[source] < events.size() && events[next_[source]].read <= read; next_[source]++)
+	{
+		value_[source] = events[next_[source]].value;
+		replayed_++;
+	}
+	return value_[source];
+}
+
+ReplaySmux::ReplaySmux(ReplayInputs &inputs) : inputs_(inputs)
+{
+}
+
+long ReplaySmux::transfer(const ubyte *msg, int msgLen, ubyte *reply, int replyLen)
+{
+	int channel = -1;
+	for (int i = 0; i < 3; i++)
+		if (msgLen >= 1 && msg[0] == SMUX_ADDRESSES[i])
+			channel = i;
+	if (channel < 0)
+		return -1;
+
+	// the channels only ever carry touch sensors on the robot, so any data read is a touch read
+	if (msgLen >= 2 && msg[1] == SMUX_DATA_REG && replyLen >= 2)
+	{
+		reply[0] = inputs_.next(replayTouch + channel) ? 1 : 0;
+		reply[1] = (ubyte)inputs_.next(replayBumps + channel);
+	}
+	return timing_.setupUs + (msgLen + (replyLen > 0 ? replyLen + 1 : 0)) * timing_.byteUs + timing_.pendingUs;
+}
+
+CommandTrace::CommandTrace(FILE *file) : file_(file)
+{
+	for (int m = 0; m < kNumbOfRealMotors; m++)
+		last_[m] = 0;
+	fprintf(file_, "t,motorA,motorB,motorC,motorD\n");
+}
+
+void CommandTrace::tick(long long nowUs)
+{
+	bool changed = false;
+	for (int m = 0; m < kNumbOfRealMotors; m++)
+	{
+		changed |= motor[m] != last_[m];
+		last_[m] = motor[m];
+	}
+	if (changed)
+		fprintf(file_, "%.3f,%d,%d,%d,%d\n", nowUs / 1e6, last_[0], last_[1], last_[2], last_[3]);
+}
@@ -0,0 +1,127 @@
+/*
+Replay of a recorded run for the host HAL
+Description: Feeds the inputs a mission recorded with UW_recorder.c back to an unmodified mission. Every
+read the mission makes of the buttons, the ultrasonic, the gyro, the colour sensor, the drive encoders
+and rand() goes through the HalInputs interface, and the SMUX on S4 answers its touch reads itself; each
+read gets the value recorded for that read of that input, counted from the start of the program, so the
+mission sees its inputs change read by read as they did on the robot. Time, the world and the bus are
+the host's own: the SMUX answers in SmuxTiming's default time without jitter, NAKs or stalls.
+
+A run recorded on the host with that bus timing (--i2c jitter=0) replays to exactly the motor commands
+of the original run, because the mission then makes the same reads at the same virtual times;
+bin/replaytest checks it with the command traces CommandTrace writes. A robot run follows the recording
+for as long as the mission reads its inputs as often as it did on the robot.
+*/
+
+#ifndef __REPLAY_H__
+#define __REPLAY_H__
+
+#include "robotc_hal.h"
+#include "smux_device.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// sources of UW_recorder.c
+enum ReplaySource
+{
+	replayButtons = 0, // buttonUp, the rest follow in TEV3Buttons order to buttonAny
+	replayDistance = replayButtons + buttonAny - buttonUp + 1,
+	replayHeading,
+	replayRate,
+	replayColour,
+	replayTouch,					  // channel 1, channels 2 and 3 follow
+	replayBumps = replayTouch + 3,	  // channel 1, channels 2 and 3 follow
+	replayEncoders = replayBumps + 3, // motorA, motorB to motorD follow
+	replayRandom = replayEncoders + kNumbOfRealMotors,
+	kNumbOfReplaySources
+};
+
+struct ReplayEvent
+{
+	long read; // reads of the source so far, 1 for its first
+	int source;
+	long value;
+};
+
+class Recording
+{
+public:
+	/**
+	 * @brief Read a file written by UW_recorder.c, or a debug stream log holding its "REC" lines
+	 *
+	 * @return false with a message in error if there is no recording in the file
+	 */
+	bool load(const std::string &path, std::string *error);
+
+	const std::vector<ReplayEvent> &events() const { return events_; }
+
+	/**
+	 * @brief Events the robot lost after its writer fell behind; the replay stops following it there
+	 */
+	long dropped() const { return dropped_; }
+
+private:
+	std::vector<ReplayEvent> events_;
+	long dropped_;
+};
+
+class ReplayInputs : public HalInputs
+{
+public:
+	ReplayInputs(const Recording &recording);
+
+	long read(HalInput input, int index, long live);
+
+	/**
+	 * @brief Count a read of a source and return its recorded value
+	 */
+	long next(int source);
+
+	/**
+	 * @brief Recorded events applied so far
+	 */
+	size_t replayed() const { return replayed_; }
+
+private:
+	std::vector<ReplayEvent> events_[kNumbOfReplaySources];
+	size_t next_[kNumbOfReplaySources];
+	long reads_[kNumbOfReplaySources];
+	long value_[kNumbOfReplaySources];
+	size_t replayed_;
+};
+
+/**
+ * @brief The SMUX on S4 during a replay, answering touch reads from the recording
+ *
+ * Transactions take SmuxTiming's default time without jitter, NAKs or stalls.
+ */
+class ReplaySmux : public HalI2CDevice
+{
+public:
+	ReplaySmux(ReplayInputs &inputs);
+
+	long transfer(const ubyte *msg, int msgLen, ubyte *reply, int replyLen);
+
+private:
+	ReplayInputs &inputs_;
+	SmuxTiming timing_;
+};
+
+/**
+ * @brief Writes every change of motor[] to a CSV file, at the simulation step it was seen
+ */
+class CommandTrace : public HalTicker
+{
+public:
+	CommandTrace(FILE *file);
+
+	void tick(long long nowUs);
+
+private:
+	FILE *file_;
+	int last_[kNumbOfRealMotors];
+};
+
+#endif // __REPLAY_H__
@@ -0,0 +1,171 @@
+/*
+Replay test
+Description: Runs For_Report-Tape in every room of the corpus in each of its cleaning modes with its
+inputs recorded (UW_recorder.c), replays each recording with --replay, and fails unless the replay sends
+the motors exactly the commands of the original run at the same virtual times, as --commands writes them.
+The original runs use SMUX timing without jitter, the timing the replay's SMUX answers with (see
+replay.h). The files of a run that did not replay are left in the directory printed for it.
+
+Usage: bin/replaytest [--rooms DIR] [--minutes N] [--seed N] [--jobs N]
+*/
+
+#include "runner.h"
+#include "work_pool.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <ftw.h>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char *MODES[] = {"random", "lanes", "frontier"};
+static const int NUMB_OF_MODES = 3;
+
+struct ReplayCase
+{
+	std::string room;
+	std::string mode;
+	std::string dir;
+	bool ran;
+	int commands;		  // lines of the original run's command trace
+	int firstDifference; // line of the traces that first differs, 0 if none does
+	std::string original, replayed;
+};
+
+static int usage(const char *argv0)
+{
+	fprintf(stderr, "usage: %s [--rooms DIR] [--minutes N] [--seed N] [--jobs N]\n", argv0);
+	return 2;
+}
+
+static std::vector<std::string> readLines(const std::string &path)
+{
+	std::ifstream in(path.c_str());
+	std::vector<std::string> lines;
+	std::string line;
+	while (std::getline(in, line))
+		lines.push_back(line);
+	return lines;
+}
+
+static int removeEntry(const char *path, const struct stat *, int, struct FTW *)
+{
+	return remove(path);
+}
+
+/**
+ * @brief Record one run, replay it and compare the command traces
+ */
+static void runCase(const std::string &binDir, int minutes, unsigned seed, ReplayCase *test)
+{
+	mkdir((test->dir + "/original").c_str(), 0755);
+	mkdir((test->dir + "/replay").c_str(), 0755);
+
+	MissionResult result;
+	MissionJob original = {"For_Report-Tape", test->room, seed, minutes, {"--mode", test->mode, "--i2c", "jitter=0",
+		"--datalog", test->dir + "/original", "--commands", test->dir + "/original.csv"}};
+	MissionJob replay = {"For_Report-Tape", "", seed, minutes, {"--replay", test->dir + "/original/uwclean.rec",
+		"--datalog", test->dir + "/replay", "--commands", test->dir + "/replay.csv"}};
+	test->ran = runMission(binDir, original, &result) && result.fields["result"] == "complete" &&
+				runMission(binDir, replay, &result);
+
+	std::vector<std::string> originalLines = readLines(test->dir + "/original.csv");
+	std::vector<std::string> replayLines = readLines(test->dir + "/replay.csv");
+	test->commands = (int)originalLines.size() - 1;
+	test->firstDifference = 0;
+	for (size_t i = 0; i < originalLines.size() || i < replayLines.size(); i++)
+	{
+		test->original = i < originalLines.size() ? originalLines[i] : "(end)";
+		test->replayed = i < replayLines.size() ? replayLines[i] : "(end)";
+		if (test->original != test->replayed)
+		{
+			test->firstDifference = (int)i + 1;
+			break;
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	std::string binDir = executableDir(argv[0]);
+	std::string roomDir = binDir + "/../rooms";
+	int minutes = 3, jobs = 0;
+	unsigned seed = 1;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--rooms" && hasValue)
+			roomDir = argv[++i];
+		else if (arg == "--minutes" && hasValue)
+			minutes = atoi(argv[++i]);
+		else if (arg == "--seed" && hasValue)
+			seed = strtoul(argv[++i], NULL, 10);
+		else if (arg == "--jobs" && hasValue)
+			jobs = atoi(argv[++i]);
+		else
+			return usage(argv[0]);
+	}
+
+	std::vector<std::string> rooms = listRooms(roomDir);
+	if (rooms.empty())
+	{
+		fprintf(stderr, "no rooms in %s\n", roomDir.c_str());
+		return 2;
+	}
+
+	char work[] = "/tmp/replaytest.XXXXXX";
+	if (!mkdtemp(work))
+	{
+		fprintf(stderr, "cannot create a directory for the runs\n");
+		return 2;
+	}
+
+	std::vector<ReplayCase> tests;
+	for (size_t r = 0; r < rooms.size(); r++)
+	{
+		for (int m = 0; m < NUMB_OF_MODES; m++)
+		{
+			ReplayCase test;
+			test.room = rooms[r];
+			test.mode = MODES[m];
+			std::ostringstream dir;
+			dir << work << "/" << tests.size();
+			test.dir = dir.str();
+			mkdir(test.dir.c_str(), 0755);
+			tests.push_back(test);
+		}
+	}
+
+	WorkStealingPool pool(jobs);
+	pool.run(tests.size(), [&](size_t index) { runCase(binDir, minutes, seed, &tests[index]); });
+
+	int passed = 0;
+	for (size_t i = 0; i < tests.size(); i++)
+	{
+		const ReplayCase &test = tests[i];
+		std::string room = test.room.substr(test.room.rfind('/') + 1);
+		printf("%-22s %-9s", room.c_str(), test.mode.c_str());
+		if (!test.ran)
+			printf("did not run, see %s\n", test.dir.c_str());
+		else if (test.firstDifference > 0)
+			printf("differs at line %d of %s: %s, replay %s\n", test.firstDifference, test.dir.c_str(),
+				   test.original.c_str(), test.replayed.c_str());
+		else
+		{
+			printf("%5d commands, replay identical\n", test.commands);
+			passed++;
+			nftw(test.dir.c_str(), removeEntry, 8, FTW_DEPTH | FTW_PHYS);
+		}
+	}
+	if (passed == (int)tests.size())
+		rmdir(work);
+
+	printf("\n%s %d/%d replays identical to the original run\n", passed == (int)tests.size() ? "PASS" : "FAIL",
+		   passed, (int)tests.size());
+	return passed == (int)tests.size() ? 0 : 1;
+}
@@ -0,0 +1,773 @@
+/*
+Host HAL for the RobotC missions
+Description: Virtual clock and RobotC intrinsics. Every intrinsic that would touch hardware costs a
+small slice of virtual time (the poll cost), so busy-wait loops such as
+	while (abs(nMotorEncoder[motorLeft]) < target);
+make progress. The world is stepped at a fixed rate as the clock passes each step boundary.
+
+Tasks started with startTask() run as coroutines on their own stacks. Only one runs at a time and the
+scheduler is only entered from intrinsics, so a task switch looks to the mission like preemption at a
+hardware access. With task main alone, sleep() just moves the clock as before.
+*/
+
+#include "robotc_hal.h"
+
+#include <cstdarg>
+#include <cstdio>
+#include <string>
+#include <ucontext.h>
+#include <vector>
+
+int motor[kNumbOfRealMotors];
+TSensorTypes SensorType[kNumbOfRealSensors];
+TSensorModes SensorMode[kNumbOfRealSensors];
+bool bSoundActive = false;
+
+const HalEncoderArray nMotorEncoder = {};
+const HalTimerArray time1 = {1000};
+const HalTimerArray time10 = {10000};
+const HalTimerArray time100 = {100000};
+const HalSensorValueArray SensorValue = {};
+const HalI2CStatusArray nI2CStatus = {};
+const HalSysTime nSysTime = {};
+const HalSysTime nPgmTime = {};
+
+/**
+ * @brief World used when the host driver does not install one: an unobstructed floor
+ *
+ * Wheels turn at the commanded power and the gyro follows the wheel speed difference, which is
+ * enough for every encoder and gyro wait loop in the missions to terminate.
+ */
+class HalFreeWorld : public HalWorld
+{
+public:
+	HalFreeWorld() : heading_(0), rate_(0)
+	{
+		for (int m = 0; m < kNumbOfRealMotors; m++)
+			degrees_[m] = 0;
+	}
+
+	void step(float dt)
+	{
+		const float DEG_PER_SEC_PER_POWER = 10.2;
+		const float RADIUS = 4, WHEELBASE = 14;
+
+		for (int m = 0; m < kNumbOfRealMotors; m++)
+			degrees_[m] += motor[m] * DEG_PER_SEC_PER_POWER * dt;
+
+		// motors are mounted reversed, so negative power drives the wheel forwards
+		float vLeft = -motor[motorA] * DEG_PER_SEC_PER_POWER * PI / 180 * RADIUS;
+		float vRight = -motor[motorD] * DEG_PER_SEC_PER_POWER * PI / 180 * RADIUS;
+		rate_ = -(vRight - vLeft) / WHEELBASE * 180 / PI;
+		heading_ += rate_ * dt;
+	}
+
+	float motorDegrees(tMotor m) { return degrees_[m]; }
+	float gyroDegrees() { return heading_; }
+	float gyroRate() { return rate_; }
+
+	int readSensor(tSensors port, TSensorTypes type)
+	{
+		if (type == sensorEV3_Ultrasonic)
+			return 255;
+		return 0;
+	}
+
+private:
+	float degrees_[kNumbOfRealMotors];
+	float heading_, rate_;
+};
+
+struct HalI2CPort
+{
+	HalI2CDevice *device;
+	long long doneAtUs;
+	long long sentAtUs;
+	bool waiting;		// the mission has not yet seen the transaction sent at sentAtUs finish
+	long long waitUs;	// virtual time from each sendI2CMsg() to the status poll that saw it finish
+	bool failed;
+	ubyte reply[17];
+};
+
+static HalFreeWorld sFreeWorld;
+static HalWorld *sWorld = &sFreeWorld;
+static HalInputs *sInputs = NULL;
+static std::vector<HalTicker *> sTickers;
+static HalI2CPort sI2C[kNumbOfRealSensors];
+
+static long long sNowUs = 0;
+static long long sStepUs = 1000;
+static long long sNextStepUs = 1000;
+static long sPollUs = 100;
+static long long sTimeLimitUs = -1;
+static long long sMissionStartUs = -1;
+static bool sVerbose = false;
+static std::string sFileDir;
+static std::vector<FILE *> sFiles;	// open files, indexed by handle
+
+static long long sTimerBaseUs[kNumbOfTimers];
+static long sEncoderOffset[kNumbOfRealMotors];
+static float sGyroOffset;
+static bool sButtons[buttonAny];
+static int sColorOverride = -1;
+static char sDisplay[kNumbOfDisplayLines][64];
+
+const long TASK_STACK_BYTES = 256 * 1024;
+const long long TIME_SLICE_US = 1000;
+
+struct HalTask
+{
+	void (*entry)();
+	int priority;
+	long long wakeAtUs;
+	long long sliceStartUs;
+	bool done;
+	ucontext_t context;
+	std::vector<char> stack;
+};
+
+// sTasks[0] is task main, running on the host's own stack; empty until the first startTask()
+static std::vector<HalTask *> sTasks;
+static size_t sCurrentTask = 0;
+static bool sStopPending = false;
+static HalStop sPendingStop;
+
+static void preempt();
+
+/**
+ * @brief Charge the poll cost of one hardware access to the virtual clock
+ */
+static void halTick()
+{
+	halAdvance(sPollUs);
+	if (!sTasks.empty())
+		preempt();
+}
+
+void halReset()
+{
+	for (size_t i = 0; i < sTasks.size(); i++)
+		delete sTasks[i];
+	sTasks.clear();
+	sCurrentTask = 0;
+	sStopPending = false;
+	sWorld = &sFreeWorld;
+	sInputs = NULL;
+	sTickers.clear();
+	memset(sI2C, 0, sizeof(sI2C));
+	memset(motor, 0, sizeof(motor));
+	memset(SensorType, 0, sizeof(SensorType));
+	memset(SensorMode, 0, sizeof(SensorMode));
+	memset(sTimerBaseUs, 0, sizeof(sTimerBaseUs));
+	memset(sEncoderOffset, 0, sizeof(sEncoderOffset));
+	memset(sButtons, 0, sizeof(sButtons));
+	memset(sDisplay, 0, sizeof(sDisplay));
+	sNowUs = 0;
+	sNextStepUs = sStepUs;
+	sTimeLimitUs = -1;
+	sMissionStartUs = -1;
+	sGyroOffset = 0;
+	sColorOverride = -1;
+}
+
+void halSetWorld(HalWorld *world)
+{
+	sWorld = world ? world : &sFreeWorld;
+}
+
+void halSetInputs(HalInputs *inputs)
+{
+	sInputs = inputs;
+}
+
+/**
+ * @brief What the mission reads of an input: the live value, or the replay's answer
+ */
+static long readInput(HalInput input, int index, long live)
+{
+	return sInputs ? sInputs->read(input, index, live) : live;
+}
+
+void halAttachI2C(tSensors port, HalI2CDevice *device)
+{
+	sI2C[port].device = device;
+}
+
+long long halI2CWaitUs(tSensors port)
+{
+	return sI2C[port].waitUs;
+}
+
+void halAddTicker(HalTicker *ticker)
+{
+	sTickers.push_back(ticker);
+}
+
+void halSetStepRate(int hz)
+{
+	sStepUs = 1000000 / hz;
+	sNextStepUs = sNowUs + sStepUs;
+}
+
+void halSetPollCost(long us)
+{
+	sPollUs = us;
+}
+
+void halSetTimeLimit(long long us)
+{
+	sTimeLimitUs = us;
+}
+
+void halSetVerbose(bool verbose)
+{
+	sVerbose = verbose;
+}
+
+void halSetFileDir(const char *dir)
+{
+	sFileDir = dir ? dir : "";
+}
+
+/**
+ * @brief Move the virtual clock forward, stepping the world at each step boundary passed
+ *
+ * @param us microseconds to advance
+ */
+void halAdvance(long long us)
+{
+	long long target = sNowUs + us;
+
+	while (sNextStepUs <= target)
+	{
+		sNowUs = sNextStepUs;
+		sWorld->step(sStepUs / 1e6f);
+		for (size_t i = 0; i < sTickers.size(); i++)
+			sTickers[i]->tick(sNowUs);
+		sNextStepUs += sStepUs;
+	}
+	sNowUs = target;
+
+	if (sTimeLimitUs >= 0 && sNowUs > sTimeLimitUs)
+	{
+		HalStop stop = {true};
+		throw stop;
+	}
+}
+
+long long halNowUs()
+{
+	return sNowUs;
+}
+
+void halSetButton(TEV3Buttons button, bool pressed)
+{
+	sButtons[button] = pressed;
+}
+
+void halSetColorOverride(int colour)
+{
+	sColorOverride = colour;
+}
+
+void halMissionStarted()
+{
+	sMissionStartUs = sNowUs;
+	sWorld->start();
+}
+
+long long halMissionStartUs()
+{
+	return sMissionStartUs;
+}
+
+const char *halDisplayLine(int line)
+{
+	return sDisplay[line];
+}
+
+long halGetEncoder(tMotor m)
+{
+	halTick();
+	return readInput(halInputEncoder, m, lround(sWorld->motorDegrees(m)) - sEncoderOffset[m]);
+}
+
+void halSetEncoder(tMotor m, long value)
+{
+	sEncoderOffset[m] = lround(sWorld->motorDegrees(m)) - value;
+}
+
+long halGetTimer(TTimers timer, long unitUs)
+{
+	halTick();
+	return (long)((sNowUs - sTimerBaseUs[timer]) / unitUs);
+}
+
+void halSetTimer(TTimers timer, long unitUs, long value)
+{
+	sTimerBaseUs[timer] = sNowUs - (long long)value * unitUs;
+}
+
+long halSysTime()
+{
+	halTick();
+	return (long)(sNowUs / 1000);
+}
+
+int halSensorValue(tSensors port)
+{
+	switch (SensorType[port])
+	{
+	case sensorEV3_Gyro:
+		return getGyroDegrees(port);
+
+	case sensorEV3_Color:
+		halTick();
+		if (sColorOverride >= 0)
+			return readInput(halInputSensor, port, sColorOverride);
+		return readInput(halInputSensor, port, sWorld->readSensor(port, SensorType[port]));
+
+	default:
+		halTick();
+		return readInput(halInputSensor, port, sWorld->readSensor(port, SensorType[port]));
+	}
+}
+
+TI2CStatus halI2CStatus(tSensors port)
+{
+	halTick();
+	HalI2CPort &bus = sI2C[port];
+	if (sNowUs < bus.doneAtUs && !bus.failed)
+		return i2cStatusPending;
+	if (bus.waiting)
+	{
+		bus.waitUs += sNowUs - bus.sentAtUs;
+		bus.waiting = false;
+	}
+	return bus.failed ? i2cStatusFailed : i2cStatusNoError;
+}
+
+long getMotorEncoder(tMotor m)
+{
+	return halGetEncoder(m);
+}
+
+void resetMotorEncoder(tMotor m)
+{
+	halSetEncoder(m, 0);
+}
+
+void setMotorSpeed(tMotor m, int power)
+{
+	motor[m] = power;
+}
+
+int getGyroDegrees(tSensors port)
+{
+	halTick();
+	return readInput(halInputGyroDegrees, port, lround(sWorld->gyroDegrees() - sGyroOffset));
+}
+
+int getGyroRate(tSensors port)
+{
+	halTick();
+	return readInput(halInputGyroRate, port, lround(sWorld->gyroRate()));
+}
+
+void resetGyro(tSensors port)
+{
+	halTick();
+	sGyroOffset = sWorld->gyroDegrees();
+}
+
+int getColorName(tSensors port)
+{
+	return halSensorValue(port);
+}
+
+bool getButtonPress(TEV3Buttons button)
+{
+	halTick();
+	bool pressed = false;
+	if (button != buttonAny)
+		pressed = sButtons[button];
+	for (int b = buttonUp; b < buttonAny && button == buttonAny; b++)
+		pressed |= sButtons[b];
+	return readInput(halInputButton, button, pressed) != 0;
+}
+
+static void sleepUntil(long long wakeAtUs);
+
+void sleep(long ms)
+{
+	if (sTasks.empty())
+		halAdvance((long long)ms * 1000);
+	else
+		sleepUntil(sNowUs + (long long)ms * 1000);
+}
+
+void wait1Msec(long ms)
+{
+	sleep(ms);
+}
+
+void wait10Msec(long tenMs)
+{
+	sleep(tenMs * 10);
+}
+
+/**
+ * @brief Write formatted text over the start of a display line, leaving the rest of the line
+ */
+static void displayWrite(int line, bool clearLine, const char *format, va_list args)
+{
+	char text[64];
+
+	if (line < 0 || line >= kNumbOfDisplayLines)
+		return;
+	vsnprintf(text, sizeof(text), format, args);
+	if (clearLine)
+		memset(sDisplay[line], 0, sizeof(sDisplay[line]));
+
+	size_t len = strlen(text);
+	size_t old = strlen(sDisplay[line]);
+	memcpy(sDisplay[line], text, len);
+	if (len >= old)
+		sDisplay[line][len] = 0;
+
+	if (sVerbose)
+		fprintf(stderr, "[%9.3f] display %2d: %s\n", sNowUs / 1e6, line, sDisplay[line]);
+}
+
+void displayString(int line, const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	displayWrite(line, false, format, args);
+	va_end(args);
+}
+
+void displayTextLine(int line, const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	displayWrite(line, true, format, args);
+	va_end(args);
+}
+
+void displayBigTextLine(int line, const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	displayWrite(line, true, format, args);
+	va_end(args);
+}
+
+void eraseDisplay()
+{
+	memset(sDisplay, 0, sizeof(sDisplay));
+}
+
+void playTone(int frequency, int durationIn10MsecTicks)
+{
+}
+
+void playSound(TSounds sound)
+{
+}
+
+void setLEDColor(TLEDPatterns pattern)
+{
+}
+
+static char sDebugLine[256];
+
+static void debugWrite(bool endLine, const char *format, va_list args)
+{
+	size_t used = strlen(sDebugLine);
+	vsnprintf(sDebugLine + used, sizeof(sDebugLine) - used, format, args);
+	if (!endLine)
+		return;
+	if (sVerbose)
+		fprintf(stderr, "[%9.3f] debug: %s\n", sNowUs / 1e6, sDebugLine);
+	sDebugLine[0] = 0;
+}
+
+void writeDebugStream(const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	debugWrite(false, format, args);
+	va_end(args);
+}
+
+void writeDebugStreamLine(const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	debugWrite(true, format, args);
+	va_end(args);
+}
+
+long fileOpenWrite(const char *fileName)
+{
+	halTick();
+	if (sFileDir.empty())
+		return -1;
+
+	FILE *file = fopen((sFileDir + "/" + fileName).c_str(), "wb");
+	if (!file)
+		return -1;
+	sFiles.push_back(file);
+	return (long)sFiles.size() - 1;
+}
+
+bool fileWriteData(long fileHandle, const void *data, long length)
+{
+	halTick();
+	if (fileHandle < 0 || fileHandle >= (long)sFiles.size() || !sFiles[fileHandle])
+		return false;
+	return fwrite(data, 1, length, sFiles[fileHandle]) == (size_t)length;
+}
+
+bool fileClose(long fileHandle)
+{
+	halTick();
+	if (fileHandle < 0 || fileHandle >= (long)sFiles.size() || !sFiles[fileHandle])
+		return false;
+	bool ok = fclose(sFiles[fileHandle]) == 0;
+	sFiles[fileHandle] = NULL;
+	return ok;
+}
+
+/**
+ * @brief Start an I2C transaction; the port reads as pending until the device's latency elapses
+ *
+ * A port with no device attached answers with zeros straight away, like an idle bus.
+ */
+void sendI2CMsg(tSensors port, ubyte *msg, int replyLen)
+{
+	HalI2CPort &bus = sI2C[port];
+
+	halTick();
+	memset(bus.reply, 0, sizeof(bus.reply));
+	bus.failed = false;
+	bus.doneAtUs = sNowUs;
+	bus.sentAtUs = sNowUs;
+	bus.waiting = true;
+
+	if (SensorType[port] != sensorEV3_GenericI2C && SensorType[port] != sensorI2CCustom &&
+		SensorType[port] != sensorI2CCustom9V)
+	{
+		bus.failed = true;
+		return;
+	}
+	if (!bus.device)
+		return;
+
+	long latency = bus.device->transfer(&msg[1], msg[0], bus.reply, replyLen);
+	if (latency < 0)
+		bus.failed = true;
+	else
+		bus.doneAtUs = sNowUs + latency;
+}
+
+void readI2CReply(tSensors port, ubyte *reply, int replyLen)
+{
+	halTick();
+	memcpy(reply, sI2C[port].reply, replyLen);
+}
+
+void setSensorAutoID(tSensors port, bool enable)
+{
+}
+
+void setSensorConnectionType(tSensors port, TSensorConnType type)
+{
+}
+
+int halRandom()
+{
+	return readInput(halInputRandom, 0, std::rand() % 32768);
+}
+
+void hogCPU()
+{
+}
+
+void releaseCPU()
+{
+}
+
+/**
+ * @brief Ready task to run next: the highest priority, taking turns after the current task
+ *
+ * @param others false to let the current task be chosen
+ * @return index into sTasks, or -1 if nothing is ready
+ */
+static int nextTask(bool others)
+{
+	int best = -1;
+	size_t n = sTasks.size();
+
+	for (size_t i = 1; i <= n; i++)
+	{
+		size_t index = (sCurrentTask + i) % n;
+		HalTask *t = sTasks[index];
+		if (t->done || t->wakeAtUs > sNowUs || (others && index == sCurrentTask))
+			continue;
+		if (best < 0 || t->priority > sTasks[best]->priority)
+			best = (int)index;
+	}
+	return best;
+}
+
+/**
+ * @brief Resume another task; returns when something switches back to this one
+ */
+static void switchTo(size_t index)
+{
+	if (index == sCurrentTask)
+		return;
+
+	HalTask *from = sTasks[sCurrentTask];
+	sCurrentTask = index;
+	sTasks[index]->sliceStartUs = sNowUs;
+	swapcontext(&from->context, &sTasks[index]->context);
+
+	// a background task that hit stopAllTasks() or the time limit hands its stop to task main
+	if (sCurrentTask == 0 && sStopPending)
+	{
+		sStopPending = false;
+		throw sPendingStop;
+	}
+}
+
+/**
+ * @brief Run whatever is ready until the current task is, moving the clock on while nothing is
+ */
+static void runUntilReady()
+{
+	while (true)
+	{
+		int next = nextTask(false);
+		if (next >= 0)
+		{
+			switchTo(next);
+			return;
+		}
+
+		long long wakeAtUs = -1;
+		for (size_t i = 0; i < sTasks.size(); i++)
+			if (!sTasks[i]->done && (wakeAtUs < 0 || sTasks[i]->wakeAtUs < wakeAtUs))
+				wakeAtUs = sTasks[i]->wakeAtUs;
+		halAdvance(wakeAtUs - sNowUs);
+	}
+}
+
+static void sleepUntil(long long wakeAtUs)
+{
+	sTasks[sCurrentTask]->wakeAtUs = wakeAtUs;
+	runUntilReady();
+}
+
+/**
+ * @brief Switch away at an intrinsic call if a higher priority task is ready or the slice is used up
+ */
+static void preempt()
+{
+	int next = nextTask(false);
+	if (next < 0 || (size_t)next == sCurrentTask)
+		return;
+
+	HalTask *current = sTasks[sCurrentTask];
+	if (sTasks[next]->priority > current->priority ||
+		(sTasks[next]->priority == current->priority && sNowUs - current->sliceStartUs >= TIME_SLICE_US))
+		switchTo(next);
+}
+
+static void taskEntry()
+{
+	HalTask *self = sTasks[sCurrentTask];
+	try
+	{
+		self->entry();
+	}
+	catch (HalStop &stop)
+	{
+		sPendingStop = stop;
+		sStopPending = true;
+	}
+	self->done = true;
+
+	if (sStopPending)
+		switchTo(0);
+	runUntilReady();
+}
+
+/**
+ * @brief Give up the rest of the time slice to another ready task of the same priority
+ *
+ * As on the brick, the scheduler is strictly by priority: a lower priority task does not get the CPU
+ * from a task that yields, only from one that sleeps or ends.
+ */
+void abortTimeslice()
+{
+	halTick();
+	if (sTasks.empty())
+		return;
+
+	int next = nextTask(true);
+	if (next >= 0 && sTasks[next]->priority >= sTasks[sCurrentTask]->priority)
+		switchTo(next);
+}
+
+void startTask(void (*task)(), int priority)
+{
+	if (sTasks.empty())
+	{
+		HalTask *main = new HalTask();
+		main->priority = kDefaultTaskPriority;
+		main->sliceStartUs = sNowUs;
+		sTasks.push_back(main);
+	}
+
+	HalTask *t = new HalTask();
+	t->entry = task;
+	t->priority = priority;
+	t->wakeAtUs = sNowUs;
+	t->stack.resize(TASK_STACK_BYTES);
+	getcontext(&t->context);
+	t->context.uc_stack.ss_sp = &t->stack[0];
+	t->context.uc_stack.ss_size = t->stack.size();
+	t->context.uc_link = NULL;
+	makecontext(&t->context, taskEntry, 0);
+	sTasks.push_back(t);
+
+	// a new task with a higher priority starts straight away
+	halTick();
+}
+
+void stopTask(void (*task)())
+{
+	for (size_t i = 1; i < sTasks.size(); i++)
+	{
+		if (sTasks[i]->entry != task || sTasks[i]->done)
+			continue;
+		sTasks[i]->done = true;
+		if (i == sCurrentTask)
+			runUntilReady();
+	}
+}
+
+void stopAllTasks()
+{
+	HalStop stop = {false};
+	throw stop;
+}
+
+short stringFind(const char *haystack, const char *needle)
+{
+	const char *found = strstr(haystack, needle);
+	return found ? (short)(found - haystack) : -1;
+}
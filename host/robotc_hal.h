@@ -0,0 +1,425 @@
+/*
+Host HAL for the RobotC missions
+Description: Implements the RobotC EV3 intrinsics used by the mission files (motor[], nMotorEncoder[],
+SensorValue[], getGyroDegrees/resetGyro, time100[T1], wait1Msec/sleep, displayString, getButtonPress,
+playTone, sendI2CMsg/readI2CReply/nI2CStatus, fileOpenWrite, rand) on top of a virtual clock so an unmodified task main runs
+on Linux. Time only advances when the program sleeps or touches the hardware, so a 5 minute mission
+finishes in milliseconds of wall time.
+
+Mission files are compiled as C++ with this header forced in front of them (see host/Makefile):
+	g++ -x c++ -include robotc_hal.h -DROBOTC_MISSION -I host -I . For_Report-Tape.c ...
+ROBOTC_MISSION maps "task main()" onto robotcMain() so the host driver can own main().
+*/
+
+#ifndef __ROBOTC_HAL_H__
+#define __ROBOTC_HAL_H__
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+using std::abs;
+
+#define EV3 1
+
+#ifndef PI
+#define PI 3.14159265358979
+#endif
+
+typedef unsigned char ubyte;
+typedef signed char sbyte;
+
+#define kNumbOfRealSensors 4
+#define kNumbOfRealMotors 4
+#define kNumbOfTimers 4
+#define kNumbOfDisplayLines 16
+
+typedef enum tSensors
+{
+	S1 = 0,
+	S2,
+	S3,
+	S4
+} tSensors;
+
+typedef enum tMotor
+{
+	motorA = 0,
+	motorB,
+	motorC,
+	motorD
+} tMotor;
+
+typedef enum TSensorTypes
+{
+	sensorNone = 0,
+	sensorTouch,
+	sensorSONAR,
+	sensorI2CCustom,
+	sensorI2CCustom9V,
+	sensorEV3_Touch,
+	sensorEV3_Ultrasonic,
+	sensorEV3_Gyro,
+	sensorEV3_Color,
+	sensorEV3_IRSensor,
+	sensorEV3_GenericI2C,
+	sensorEV3_EnergyMeter
+} TSensorTypes;
+
+typedef enum TSensorModes
+{
+	modeEV3Default = 0,
+	modeEV3Gyro_Angle,
+	modeEV3Gyro_Rate,
+	modeEV3Gyro_RateAndAngle,
+	modeEV3Gyro_Calibration,
+	modeEV3Color_Reflected,
+	modeEV3Color_Ambient,
+	modeEV3Color_Color,
+	modeEV3Ultrasonic_Cm
+} TSensorModes;
+
+typedef enum TColors
+{
+	colorNone = 0,
+	colorBlack,
+	colorBlue,
+	colorGreen,
+	colorYellow,
+	colorRed,
+	colorWhite,
+	colorBrown
+} TColors;
+
+typedef enum TI2CStatus
+{
+	i2cStatusNoError = 0,
+	i2cStatusPending,
+	i2cStatusFailed,
+	i2cStatusBadConfig,
+	i2cStatusStartTransfer,
+	i2cStatusStopped
+} TI2CStatus;
+
+typedef enum TEV3Buttons
+{
+	buttonNone = 0,
+	buttonUp,
+	buttonEnter,
+	buttonDown,
+	buttonRight,
+	buttonLeft,
+	buttonBack,
+	buttonAny
+} TEV3Buttons;
+
+typedef enum TTimers
+{
+	T1 = 0,
+	T2,
+	T3,
+	T4
+} TTimers;
+
+typedef enum TSounds
+{
+	soundBlip = 0,
+	soundBeepBeep,
+	soundDownwardTones,
+	soundUpwardTones,
+	soundLowBuzz,
+	soundFastUpwardTones,
+	soundShortBlip,
+	soundException
+} TSounds;
+
+typedef enum TLEDPatterns
+{
+	ledOff = 0,
+	ledGreen,
+	ledRed,
+	ledOrange,
+	ledGreenFlash,
+	ledRedFlash,
+	ledOrangeFlash,
+	ledGreenPulse,
+	ledRedPulse,
+	ledOrangePulse
+} TLEDPatterns;
+
+typedef enum TSensorConnType
+{
+	CONN_NONE = 0,
+	CONN_INPUT_DUMB,
+	CONN_NXT_IIC
+} TSensorConnType;
+
+/**
+ * @brief Thrown by stopAllTasks() and by the virtual time limit to unwind the mission
+ */
+struct HalStop
+{
+	bool timedOut;
+};
+
+/**
+ * @brief The physical world behind the HAL: motors in, sensor readings out
+ *
+ * The HAL owns the clock and RobotC bookkeeping (encoder/gyro offsets, timers); the world only
+ * integrates motor[] forward in time and reports raw readings.
+ */
+class HalWorld
+{
+public:
+	virtual ~HalWorld() {}
+
+	/**
+	 * @brief Called once when the operator starts the mission from the robot's final prompt
+	 */
+	virtual void start() {}
+
+	/**
+	 * @brief Integrate the world forward with the current motor[] powers
+	 *
+	 * @param dt step length in seconds
+	 */
+	virtual void step(float dt) = 0;
+
+	/**
+	 * @brief Raw motor shaft angle in degrees since power up
+	 */
+	virtual float motorDegrees(tMotor m) = 0;
+
+	/**
+	 * @brief Raw gyro angle in degrees since power up, clockwise positive like the EV3 gyro
+	 */
+	virtual float gyroDegrees() = 0;
+
+	/**
+	 * @brief Gyro rate in degrees per second, clockwise positive
+	 */
+	virtual float gyroRate() = 0;
+
+	/**
+	 * @brief SensorValue[] for any non-gyro port, interpreted by the port's configured type
+	 */
+	virtual int readSensor(tSensors port, TSensorTypes type) = 0;
+};
+
+/**
+ * @brief A device answering sendI2CMsg() on one sensor port
+ */
+class HalI2CDevice
+{
+public:
+	virtual ~HalI2CDevice() {}
+
+	/**
+	 * @brief Handle one bus transaction
+	 *
+	 * @param msg message bytes after the length byte (address, register, data)
+	 * @param msgLen number of bytes in msg
+	 * @param reply buffer to fill with replyLen bytes
+	 * @param replyLen number of reply bytes requested
+	 * @return transaction duration in microseconds, or -1 if the device NAKed
+	 */
+	virtual long transfer(const ubyte *msg, int msgLen, ubyte *reply, int replyLen) = 0;
+};
+
+/**
+ * @brief Anything that needs to run on every simulation step (the scripted operator, recorders)
+ */
+class HalTicker
+{
+public:
+	virtual ~HalTicker() {}
+	virtual void tick(long long nowUs) = 0;
+};
+
+// inputs the mission reads, see HalInputs
+typedef enum HalInput
+{
+	halInputButton,		 // getButtonPress(), index is the button
+	halInputSensor,		 // SensorValue[] of any port but a gyro, index is the port
+	halInputGyroDegrees, // getGyroDegrees() and SensorValue[] of a gyro, index is the port
+	halInputGyroRate,	 // getGyroRate(), index is the port
+	halInputEncoder,	 // nMotorEncoder[] and getMotorEncoder(), index is the motor
+	halInputRandom		 // rand(), index is 0
+} HalInput;
+
+/**
+ * @brief Answers the mission's reads of its inputs in place of the world and the operator (a replay)
+ *
+ * Every read of an input goes through read() once, in the order the mission makes them, after the HAL
+ * has charged the read's poll cost. I2C devices answer their own transactions.
+ */
+class HalInputs
+{
+public:
+	virtual ~HalInputs() {}
+
+	/**
+	 * @brief Value the mission gets
+	 *
+	 * @param input what is read
+	 * @param index button, port or motor, see HalInput
+	 * @param live what the HAL would have returned
+	 */
+	virtual long read(HalInput input, int index, long live) = 0;
+};
+
+// host side control of the HAL
+void halReset();
+void halSetWorld(HalWorld *world);
+void halSetInputs(HalInputs *inputs);
+void halAttachI2C(tSensors port, HalI2CDevice *device);
+long long halI2CWaitUs(tSensors port);
+void halAddTicker(HalTicker *ticker);
+void halSetStepRate(int hz);
+void halSetPollCost(long us);
+void halSetTimeLimit(long long us);
+void halSetVerbose(bool verbose);
+void halSetFileDir(const char *dir);
+void halAdvance(long long us);
+long long halNowUs();
+void halSetButton(TEV3Buttons button, bool pressed);
+void halSetColorOverride(int colour);
+void halMissionStarted();
+long long halMissionStartUs();
+const char *halDisplayLine(int line);
+
+// the mission's task main, renamed by ROBOTC_MISSION
+void robotcMain();
+
+// RobotC intrinsics
+extern int motor[kNumbOfRealMotors];
+extern TSensorTypes SensorType[kNumbOfRealSensors];
+extern TSensorModes SensorMode[kNumbOfRealSensors];
+extern bool bSoundActive;
+
+long halGetEncoder(tMotor m);
+void halSetEncoder(tMotor m, long value);
+long halGetTimer(TTimers timer, long unitUs);
+void halSetTimer(TTimers timer, long unitUs, long value);
+int halSensorValue(tSensors port);
+TI2CStatus halI2CStatus(tSensors port);
+long halSysTime();
+
+class HalEncoderRef
+{
+public:
+	HalEncoderRef(tMotor m) : m_(m) {}
+	operator long() const { return halGetEncoder(m_); }
+	HalEncoderRef &operator=(long value) { halSetEncoder(m_, value); return *this; }
+private:
+	tMotor m_;
+};
+
+struct HalEncoderArray
+{
+	HalEncoderRef operator[](tMotor m) const { return HalEncoderRef(m); }
+};
+
+class HalTimerRef
+{
+public:
+	HalTimerRef(TTimers timer, long unitUs) : timer_(timer), unitUs_(unitUs) {}
+	operator long() const { return halGetTimer(timer_, unitUs_); }
+	HalTimerRef &operator=(long value) { halSetTimer(timer_, unitUs_, value); return *this; }
+private:
+	TTimers timer_;
+	long unitUs_;
+};
+
+struct HalTimerArray
+{
+	long unitUs;
+	HalTimerRef operator[](TTimers timer) const { return HalTimerRef(timer, unitUs); }
+};
+
+struct HalSensorValueArray
+{
+	int operator[](tSensors port) const { return halSensorValue(port); }
+	int operator()(tSensors port) const { return halSensorValue(port); }
+};
+
+struct HalI2CStatusArray
+{
+	TI2CStatus operator[](tSensors port) const { return halI2CStatus(port); }
+};
+
+struct HalSysTime
+{
+	operator long() const { return halSysTime(); }
+};
+
+extern const HalEncoderArray nMotorEncoder;
+extern const HalTimerArray time1, time10, time100;
+extern const HalSensorValueArray SensorValue;
+extern const HalI2CStatusArray nI2CStatus;
+extern const HalSysTime nSysTime, nPgmTime;
+
+long getMotorEncoder(tMotor m);
+void resetMotorEncoder(tMotor m);
+void setMotorSpeed(tMotor m, int power);
+
+int getGyroDegrees(tSensors port);
+int getGyroRate(tSensors port);
+void resetGyro(tSensors port);
+int getColorName(tSensors port);
+
+bool getButtonPress(TEV3Buttons button);
+
+void sleep(long ms);
+void wait1Msec(long ms);
+void wait10Msec(long tenMs);
+
+void displayString(int line, const char *format, ...);
+void displayTextLine(int line, const char *format, ...);
+void displayBigTextLine(int line, const char *format, ...);
+void eraseDisplay();
+
+void playTone(int frequency, int durationIn10MsecTicks);
+void playSound(TSounds sound);
+void setLEDColor(TLEDPatterns pattern);
+
+void writeDebugStream(const char *format, ...);
+void writeDebugStreamLine(const char *format, ...);
+
+// the brick's file system: files go to the directory set by halSetFileDir(), opening fails without one
+long fileOpenWrite(const char *fileName);
+bool fileWriteData(long fileHandle, const void *data, long length);
+bool fileClose(long fileHandle);
+
+void sendI2CMsg(tSensors port, ubyte *msg, int replyLen);
+void readI2CReply(tSensors port, ubyte *reply, int replyLen);
+void setSensorAutoID(tSensors port, bool enable);
+void setSensorConnectionType(tSensors port, TSensorConnType type);
+
+void hogCPU();
+void releaseCPU();
+void abortTimeslice();
+void stopAllTasks();
+
+#define kLowPriority 0
+#define kDefaultTaskPriority 7
+#define kHighPriority 255
+
+// tasks share the virtual clock: a higher priority task that is ready preempts at the next intrinsic
+// call, equal priorities take turns every time slice, and sleep() hands the CPU to the next ready task
+void startTask(void (*task)(), int priority = kDefaultTaskPriority);
+void stopTask(void (*task)());
+
+short stringFind(const char *haystack, const char *needle);
+
+// RobotC's rand(), 0 to 32767 like on the brick
+int halRandom();
+
+
+#ifdef ROBOTC_MISSION
+#define task void
+#define main robotcMain
+#define rand() halRandom()
+#endif
+
+#endif // __ROBOTC_HAL_H__
@@ -0,0 +1,243 @@
+#include "room.h"
+#include "robotc_hal.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+Room::Room() : floorColour(colorNone), startHeading(0), edges(0)
+{
+	start.x = start.y = 0;
+	lower.x = lower.y = DBL_MAX;
+	upper.x = upper.y = -DBL_MAX;
+	area.colour = colorNone;
+}
+
+/**
+ * @brief Parse a colour given by EV3 colour name or number
+ */
+static bool parseColour(const std::string &word, int *colour)
+{
+	static const char *NAMES[] = {"none", "black", "blue", "green", "yellow", "red", "white", "brown"};
+
+	for (int c = 0; c < 8; c++)
+	{
+		if (word == NAMES[c])
+		{
+			*colour = c;
+			return true;
+		}
+	}
+	std::istringstream number(word);
+	return (number >> *colour) && *colour >= colorNone && *colour <= colorBrown;
+}
+
+/**
+ * @brief Read the remaining "x y" pairs on a line into a polygon
+ */
+static bool parsePoints(std::istringstream &in, Polygon *polygon)
+{
+	Vec2 p;
+	while (in >> p.x)
+	{
+		if (!(in >> p.y))
+			return false;
+		polygon->points.push_back(p);
+	}
+	return polygon->points.size() >= 3;
+}
+
+bool Room::load(const char *path, std::string *error)
+{
+	std::ifstream file(path);
+	std::string line;
+	int lineNumber = 0;
+	bool haveArea = false;
+
+	if (!file)
+	{
+		*error = std::string("cannot open ") + path;
+		return false;
+	}
+
+	while (std::getline(file, line))
+	{
+		lineNumber++;
+		line = line.substr(0, line.find('#'));
+		std::istringstream in(line);
+		std::string word;
+		bool ok = true;
+
+		if (!(in >> word))
+			continue;
+
+		if (word == "name")
+		{
+			in >> std::ws;
+			std::getline(in, name);
+		}
+		else if (word == "walls" || word == "box")
+		{
+			Polygon polygon;
+			polygon.colour = colorNone;
+			if (word == "walls")
+				ok = parsePoints(in, &polygon);
+			else
+			{
+				double x0, y0, x1, y1;
+				ok = static_cast<bool>(in >> x0 >> y0 >> x1 >> y1);
+				Vec2 corners[4] = {{x0, y0}, {x1, y0}, {x1, y1}, {x0, y1}};
+				polygon.points.assign(corners, corners + 4);
+				obstacles.push_back(polygon);
+			}
+			for (size_t i = 0; ok && i < polygon.points.size(); i++)
+			{
+				Segment s = {polygon.points[i], polygon.points[(i + 1) % polygon.points.size()]};
+				walls.push_back(s);
+			}
+			if (ok && word == "walls" && !haveArea)
+			{
+				area = polygon;
+				haveArea = true;
+				if (edges == 0)
+					edges = (int)polygon.points.size();
+			}
+		}
+		else if (word == "wall")
+		{
+			Segment s;
+			ok = static_cast<bool>(in >> s.a.x >> s.a.y >> s.b.x >> s.b.y);
+			walls.push_back(s);
+		}
+		else if (word == "tape")
+		{
+			Polygon polygon;
+			ok = (in >> word) && parseColour(word, &polygon.colour) && parsePoints(in, &polygon);
+			tapes.push_back(polygon);
+		}
+		else if (word == "area")
+		{
+			area.points.clear();
+			ok = parsePoints(in, &area);
+			haveArea = true;
+		}
+		else if (word == "floor")
+			ok = (in >> word) && parseColour(word, &floorColour);
+		else if (word == "start")
+			ok = static_cast<bool>(in >> start.x >> start.y >> startHeading);
+		else if (word == "edges")
+			ok = static_cast<bool>(in >> edges);
+		else
+			ok = false;
+
+		if (!ok)
+		{
+			std::ostringstream message;
+			message << path << ":" << lineNumber << ": cannot parse '" << line << "'";
+			*error = message.str();
+			return false;
+		}
+	}
+
+	if (!haveArea || walls.empty())
+	{
+		*error = std::string(path) + ": room has no walls";
+		return false;
+	}
+	for (size_t i = 0; i < walls.size(); i++)
+	{
+		lower.x = std::min(lower.x, std::min(walls[i].a.x, walls[i].b.x));
+		lower.y = std::min(lower.y, std::min(walls[i].a.y, walls[i].b.y));
+		upper.x = std::max(upper.x, std::max(walls[i].a.x, walls[i].b.x));
+		upper.y = std::max(upper.y, std::max(walls[i].a.y, walls[i].b.y));
+	}
+	if (name.empty())
+		name = path;
+	return true;
+}
+
+double Room::clearance(Vec2 p, Vec2 *contact) const
+{
+	double best = DBL_MAX;
+
+	for (size_t i = 0; i < walls.size(); i++)
+	{
+		const Segment &s = walls[i];
+		double dx = s.b.x - s.a.x, dy = s.b.y - s.a.y;
+		double lengthSq = dx * dx + dy * dy;
+		double t = lengthSq > 0 ? ((p.x - s.a.x) * dx + (p.y - s.a.y) * dy) / lengthSq : 0;
+		t = t < 0 ? 0 : (t > 1 ? 1 : t);
+
+		Vec2 q = {s.a.x + t * dx, s.a.y + t * dy};
+		double distSq = (p.x - q.x) * (p.x - q.x) + (p.y - q.y) * (p.y - q.y);
+		if (distSq < best)
+		{
+			best = distSq;
+			if (contact)
+				*contact = q;
+		}
+	}
+	return sqrt(best);
+}
+
+double Room::raycast(Vec2 origin, double headingDeg, double maxRange) const
+{
+	double dx = cos(headingDeg * PI / 180), dy = sin(headingDeg * PI / 180);
+	double best = maxRange;
+
+	for (size_t i = 0; i < walls.size(); i++)
+	{
+		const Segment &s = walls[i];
+		double ex = s.b.x - s.a.x, ey = s.b.y - s.a.y;
+		double denom = dx * ey - dy * ex;
+		if (fabs(denom) < 1e-9)
+			continue;
+
+		// solve origin + t * d = a + u * e
+		double wx = s.a.x - origin.x, wy = s.a.y - origin.y;
+		double t = (wx * ey - wy * ex) / denom;
+		double u = (wx * dy - wy * dx) / denom;
+		if (t >= 0 && u >= 0 && u <= 1 && t < best)
+			best = t;
+	}
+	return best;
+}
+
+bool Room::contains(const Polygon &polygon, Vec2 p)
+{
+	bool inside = false;
+	size_t n = polygon.points.size();
+
+	for (size_t i = 0, j = n - 1; i < n; j = i++)
+	{
+		const Vec2 &a = polygon.points[i], &b = polygon.points[j];
+		if ((a.y > p.y) != (b.y > p.y) && p.x < (b.x - a.x) * (p.y - a.y) / (b.y - a.y) + a.x)
+			inside = !inside;
+	}
+	return inside;
+}
+
+int Room::colourAt(Vec2 p) const
+{
+	for (size_t i = 0; i < tapes.size(); i++)
+		if (contains(tapes[i], p))
+			return tapes[i].colour;
+	return floorColour;
+}
+
+bool Room::isFree(Vec2 p) const
+{
+	if (!contains(area, p))
+		return false;
+	for (size_t i = 0; i < obstacles.size(); i++)
+		if (contains(obstacles[i], p))
+			return false;
+	return true;
+}
+
+int Room::tapeColour() const
+{
+	return tapes.empty() ? colorRed : tapes[0].colour;
+}
@@ -0,0 +1,97 @@
+/*
+Room geometry for the host simulator
+Description: A room is a set of wall segments, box obstacles, tape polygons on the floor and the
+cleanable area the coverage figures are measured against. Units are cm, angles are degrees
+counter-clockwise from the +x axis.
+
+Room file format, one statement per line, '#' starts a comment:
+	name <text>
+	walls x1 y1 x2 y2 ... xn yn      closed wall polygon; the first one is also the cleanable area
+	wall x1 y1 x2 y2                 single wall segment
+	box x0 y0 x1 y1                  axis aligned obstacle
+	tape <colour> x1 y1 ... xn yn    tape polygon, colour by name (red, white, ...) or number
+	area x1 y1 ... xn yn             cleanable area, when it is not the first walls polygon
+	floor <colour>                   what the colour sensor reads off tape (default none)
+	start x y heading                pose the robot is placed at, wall on its right
+	edges n                          edge count the operator enters (default: first walls polygon)
+*/
+
+#ifndef __ROOM_H__
+#define __ROOM_H__
+
+#include <string>
+#include <vector>
+
+struct Vec2
+{
+	double x, y;
+};
+
+struct Segment
+{
+	Vec2 a, b;
+};
+
+struct Polygon
+{
+	std::vector<Vec2> points;
+	int colour;
+};
+
+class Room
+{
+public:
+	Room();
+
+	/**
+	 * @brief Load a room description
+	 *
+	 * @param path room file
+	 * @param error receives a message naming the offending line on failure
+	 * @return true if the file was read completely
+	 */
+	bool load(const char *path, std::string *error);
+
+	/**
+	 * @brief Distance from p to the nearest wall or obstacle edge
+	 *
+	 * @param p query point
+	 * @param contact if not NULL, receives the nearest point on that edge
+	 */
+	double clearance(Vec2 p, Vec2 *contact) const;
+
+	/**
+	 * @brief Distance along a ray to the first wall or obstacle edge, or maxRange if none
+	 */
+	double raycast(Vec2 origin, double headingDeg, double maxRange) const;
+
+	/**
+	 * @brief Colour the colour sensor sees when looking down at p
+	 */
+	int colourAt(Vec2 p) const;
+
+	/**
+	 * @brief True if p lies in the cleanable area and outside every obstacle
+	 */
+	bool isFree(Vec2 p) const;
+
+	/**
+	 * @brief Colour of the tape in this room, or red if it has none
+	 */
+	int tapeColour() const;
+
+	static bool contains(const Polygon &polygon, Vec2 p);
+
+	std::string name;
+	std::vector<Segment> walls;
+	std::vector<Polygon> obstacles;
+	std::vector<Polygon> tapes;
+	Polygon area;
+	int floorColour;
+	Vec2 start;
+	double startHeading;
+	int edges;
+	Vec2 lower, upper; // bounding box of every wall
+};
+
+#endif // __ROOM_H__
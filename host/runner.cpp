@@ -0,0 +1,146 @@
+#include "runner.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sstream>
+#include <sys/wait.h>
+#include <unistd.h>
+
+const double CURVE_SECONDS = 30;
+
+double MissionResult::number(const char *key, double fallback) const
+{
+	std::map<std::string, std::string>::const_iterator it = fields.find(key);
+	return it == fields.end() ? fallback : atof(it->second.c_str());
+}
+
+std::vector<double> MissionResult::curve() const
+{
+	std::vector<double> samples;
+	std::map<std::string, std::string>::const_iterator it = fields.find("curve");
+	if (it == fields.end())
+		return samples;
+
+	std::istringstream in(it->second);
+	std::string sample;
+	while (std::getline(in, sample, '/'))
+		samples.push_back(atof(sample.c_str()));
+	return samples;
+}
+
+double MissionResult::coverageAt(double seconds) const
+{
+	std::vector<double> samples = curve();
+	size_t index = (size_t)(seconds / CURVE_SECONDS);
+	if (index < samples.size())
+		return samples[index];
+	return number("coverage", 0);
+}
+
+bool runMission(const std::string &binDir, const MissionJob &job, MissionResult *result)
+{
+	std::string path = binDir + "/" + job.variant;
+	char seed[16], minutes[16];
+	snprintf(seed, sizeof(seed), "%u", job.seed);
+	snprintf(minutes, sizeof(minutes), "%d", job.minutes);
+
+	std::vector<std::string> args;
+	args.push_back(path);
+	if (!job.room.empty())
+	{
+		args.push_back("--room");
+		args.push_back(job.room);
+	}
+	args.push_back("--seed");
+	args.push_back(seed);
+	args.push_back("--minutes");
+	args.push_back(minutes);
+	args.insert(args.end(), job.extraArgs.begin(), job.extraArgs.end());
+
+	std::vector<char *> argv;
+	for (size_t i = 0; i < args.size(); i++)
+		argv.push_back(const_cast<char *>(args[i].c_str()));
+	argv.push_back(NULL);
+
+	// other pool threads spawn at the same time: a pipe their children inherited would keep this one's
+	// write end open until they exit, so both ends close on exec and only the dup2()ed stdout survives
+	int out[2];
+	if (pipe2(out, O_CLOEXEC) != 0)
+		return false;
+
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, out[1], STDOUT_FILENO);
+
+	pid_t pid;
+	int spawned = posix_spawn(&pid, path.c_str(), &actions, NULL, &argv[0], environ);
+	posix_spawn_file_actions_destroy(&actions);
+	close(out[1]);
+	if (spawned != 0)
+	{
+		close(out[0]);
+		return false;
+	}
+
+	std::string report;
+	char buffer[4096];
+	ssize_t got;
+	while ((got = read(out[0], buffer, sizeof(buffer))) > 0)
+		report.append(buffer, got);
+	close(out[0]);
+
+	int status;
+	waitpid(pid, &status, 0);
+
+	// exit status 1 is a mission that hit its time limit; it still reports
+	if (!WIFEXITED(status) || WEXITSTATUS(status) > 1)
+		return false;
+
+	result->fields.clear();
+	std::istringstream in(report);
+	std::string field;
+	while (in >> field)
+	{
+		size_t equals = field.find('=');
+		if (equals != std::string::npos)
+			result->fields[field.substr(0, equals)] = field.substr(equals + 1);
+	}
+	return !result->fields.empty();
+}
+
+std::vector<std::string> listRooms(const std::string &dir)
+{
+	std::vector<std::string> rooms;
+	DIR *handle = opendir(dir.c_str());
+	if (!handle)
+		return rooms;
+
+	struct dirent *entry;
+	while ((entry = readdir(handle)) != NULL)
+	{
+		size_t len = strlen(entry->d_name);
+		if (len > 5 && strcmp(entry->d_name + len - 5, ".room") == 0)
+			rooms.push_back(dir + "/" + entry->d_name);
+	}
+	closedir(handle);
+	std::sort(rooms.begin(), rooms.end());
+	return rooms;
+}
+
+std::string executableDir(const char *argv0)
+{
+	const char *slash = strrchr(argv0, '/');
+	return slash ? std::string(argv0, slash - argv0) : ".";
+}
+
+std::vector<std::string> allVariants()
+{
+	static const char *VARIANTS[] = {"RoboCode_Tape", "RoboCode_NoTape", "RoboCode1touch",
+									 "randomOnly", "For_Report-Tape", "For_Report-CodeUsedInDemo"};
+	return std::vector<std::string>(VARIANTS, VARIANTS + sizeof(VARIANTS) / sizeof(VARIANTS[0]));
+}
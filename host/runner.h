@@ -0,0 +1,68 @@
+/*
+Mission runner for the host tools
+Description: Runs one simulated mission as a child process of the variant's host binary and parses its
+key=value report. Each mission gets its own process because the RobotC globals are not re-entrant.
+*/
+
+#ifndef __RUNNER_H__
+#define __RUNNER_H__
+
+#include <map>
+#include <string>
+#include <vector>
+
+struct MissionJob
+{
+	std::string variant;
+	std::string room; // empty for none, as for a replay
+	unsigned seed;
+	int minutes;
+	std::vector<std::string> extraArgs;
+};
+
+struct MissionResult
+{
+	std::map<std::string, std::string> fields;
+
+	/**
+	 * @brief Numeric value of a report field, or fallback if it is missing
+	 */
+	double number(const char *key, double fallback) const;
+
+	/**
+	 * @brief The coverage curve in percent, one sample every 30 s of mission time
+	 */
+	std::vector<double> curve() const;
+
+	/**
+	 * @brief Coverage in percent at the given mission time, using the final value past the end of the run
+	 */
+	double coverageAt(double seconds) const;
+};
+
+/**
+ * @brief Run one mission to completion
+ *
+ * @param binDir directory holding the variant binaries
+ * @param job what to run
+ * @param result receives the parsed report
+ * @return true if the binary ran and produced a report
+ */
+bool runMission(const std::string &binDir, const MissionJob &job, MissionResult *result);
+
+/**
+ * @brief Every *.room file in a directory, sorted by name
+ */
+std::vector<std::string> listRooms(const std::string &dir);
+
+/**
+ * @brief Directory part of argv[0], so the tools find the binaries built next to them
+ */
+std::string executableDir(const char *argv0);
+
+/**
+ * @brief Every mission variant the host Makefile builds
+ */
+std::vector<std::string> allVariants();
+
+#endif // __RUNNER_H__
@@ -0,0 +1,205 @@
+#include "sim.h"
+
+#include <cmath>
+
+const double CONTACT_EPS = 0.5;		// cm, how close a wall must be to press a bumper
+const double ULTRASONIC_MAX = 255;	// cm, EV3 ultrasonic reading with nothing in range
+
+// bumper arcs in degrees relative to the robot's heading, counter-clockwise positive
+const double BUMPER_ARCS[kNumbOfBumpers][2] = {
+	{-120, -60}, // side touch, right-hand side
+	{0, 70},	 // front-left
+	{-70, 0},	 // front-right
+};
+
+SimConfig::SimConfig()
+	: wheelRadius(4), wheelbase(14), bodyRadius(12), maxDegPerSec(1020), motorTau(0.05),
+	  colourOffset(8), drumWidth(20), drumDepth(4), drumOffset(0), gyroDriftPerMin(0), gyroScale(1),
+	  motorMismatch(0)
+{
+}
+
+RoomSim::RoomSim(const Room &room, const SimConfig &config)
+	: room_(room), config_(config), gyroRate_(0), elapsed_(0), clearance_(0), started_(false), inContact_(false),
+	  collisions_(0)
+{
+	pose_.x = room.start.x;
+	pose_.y = room.start.y;
+	pose_.heading = room.startHeading;
+	for (int m = 0; m < kNumbOfRealMotors; m++)
+		speed_[m] = degrees_[m] = 0;
+	for (int b = 0; b < kNumbOfBumpers; b++)
+	{
+		bumpers_[b] = false;
+		bumpCounts_[b] = 0;
+	}
+}
+
+/**
+ * @brief The operator puts the robot down at the room's start pose
+ */
+void RoomSim::start()
+{
+	pose_.x = room_.start.x;
+	pose_.y = room_.start.y;
+	pose_.heading = room_.startHeading;
+	started_ = true;
+	clearance_ = room_.clearance(Vec2{pose_.x, pose_.y}, NULL);
+	updateContacts();
+}
+
+Vec2 RoomSim::offsetPoint(double forward, double left) const
+{
+	double h = pose_.heading * PI / 180;
+	Vec2 p = {pose_.x + forward * cos(h) - left * sin(h), pose_.y + forward * sin(h) + left * cos(h)};
+	return p;
+}
+
+void RoomSim::step(float dt)
+{
+	double lag = 1 - exp(-dt / config_.motorTau);
+
+	for (int m = 0; m < kNumbOfRealMotors; m++)
+	{
+		int power = motor[m] > 100 ? 100 : (motor[m] < -100 ? -100 : motor[m]);
+		double maxSpeed = config_.maxDegPerSec * (m == motorD ? 1 - config_.motorMismatch : 1);
+		speed_[m] += (power * maxSpeed / 100 - speed_[m]) * lag;
+		degrees_[m] += speed_[m] * dt;
+	}
+	elapsed_ += dt;
+
+	// before the start prompt the robot is in the user's hands: wheels spin, nothing moves
+	if (!started_)
+	{
+		gyroRate_ = 0;
+		return;
+	}
+
+	// motors are mounted reversed, so negative power drives a wheel forwards
+	double toCm = PI / 180 * config_.wheelRadius;
+	double vLeft = -speed_[motorA] * toCm, vRight = -speed_[motorD] * toCm;
+	double v = (vLeft + vRight) / 2;
+	double omega = (vRight - vLeft) / config_.wheelbase * 180 / PI;
+
+	pose_.heading += omega * dt;
+	gyroRate_ = -omega;
+
+	// the body is a circle so turning on the spot never collides; a move into a wall keeps only the
+	// part along the wall (the body glances off it) and slips the wheels for the rest
+	double h = pose_.heading * PI / 180;
+	Vec2 next = {pose_.x + v * dt * cos(h), pose_.y + v * dt * sin(h)};
+	if (v != 0)
+	{
+		Vec2 contact;
+		double nextClearance = room_.clearance(next, &contact);
+		if (nextClearance < config_.bodyRadius)
+		{
+			double nx = pose_.x - contact.x, ny = pose_.y - contact.y;
+			double length = hypot(nx, ny);
+			double dx = next.x - pose_.x, dy = next.y - pose_.y;
+			double into = length > 0 ? (dx * nx + dy * ny) / length : 0;
+			if (into < 0)
+			{
+				next.x -= into * nx / length;
+				next.y -= into * ny / length;
+				nextClearance = room_.clearance(next, NULL);
+			}
+		}
+		if (nextClearance >= config_.bodyRadius)
+		{
+			pose_.x = next.x;
+			pose_.y = next.y;
+			clearance_ = nextClearance;
+		}
+	}
+
+	// nothing can be touching while the nearest wall is out of reach
+	if (clearance_ > config_.bodyRadius + CONTACT_EPS)
+	{
+		if (inContact_)
+			updateContacts();
+		return;
+	}
+	updateContacts();
+}
+
+/**
+ * @brief Work out which bumpers are against a wall and count new collisions
+ */
+void RoomSim::updateContacts()
+{
+	bool pressed[kNumbOfBumpers] = {false, false, false};
+	bool contact = false;
+	Vec2 p = {pose_.x, pose_.y};
+
+	for (size_t i = 0; i < room_.walls.size(); i++)
+	{
+		const Segment &s = room_.walls[i];
+		double dx = s.b.x - s.a.x, dy = s.b.y - s.a.y;
+		double lengthSq = dx * dx + dy * dy;
+		double t = lengthSq > 0 ? ((p.x - s.a.x) * dx + (p.y - s.a.y) * dy) / lengthSq : 0;
+		t = t < 0 ? 0 : (t > 1 ? 1 : t);
+		double qx = s.a.x + t * dx - p.x, qy = s.a.y + t * dy - p.y;
+
+		if (hypot(qx, qy) > config_.bodyRadius + CONTACT_EPS)
+			continue;
+		contact = true;
+
+		double bearing = remainder(atan2(qy, qx) * 180 / PI - pose_.heading, 360);
+		for (int b = 0; b < kNumbOfBumpers; b++)
+			if (bearing >= BUMPER_ARCS[b][0] && bearing <= BUMPER_ARCS[b][1])
+				pressed[b] = true;
+	}
+
+	for (int b = 0; b < kNumbOfBumpers; b++)
+	{
+		if (pressed[b] && !bumpers_[b])
+			bumpCounts_[b]++;
+		bumpers_[b] = pressed[b];
+	}
+	if (contact && !inContact_)
+		collisions_++;
+	inContact_ = contact;
+}
+
+float RoomSim::motorDegrees(tMotor m)
+{
+	return (float)degrees_[m];
+}
+
+float RoomSim::gyroDegrees()
+{
+	double drift = config_.gyroDriftPerMin * elapsed_ / 60;
+	return (float)(-(pose_.heading - room_.startHeading) * config_.gyroScale + drift);
+}
+
+float RoomSim::gyroRate()
+{
+	return (float)(gyroRate_ * config_.gyroScale + config_.gyroDriftPerMin / 60);
+}
+
+int RoomSim::readSensor(tSensors port, TSensorTypes type)
+{
+	switch (type)
+	{
+	case sensorEV3_Ultrasonic:
+	{
+		Vec2 origin = offsetPoint(0, -config_.bodyRadius);
+		return (int)room_.raycast(origin, pose_.heading - 90, ULTRASONIC_MAX);
+	}
+
+	case sensorEV3_Color:
+		return room_.colourAt(offsetPoint(config_.colourOffset, 0));
+
+	case sensorEV3_Touch:
+		// the builds without the SMUX wire the right bumper to S3 and the left one to S4
+		if (port == S3)
+			return bumpers_[bumperRight] ? 1 : 0;
+		if (port == S4)
+			return bumpers_[bumperLeft] ? 1 : 0;
+		return 0;
+
+	default:
+		return 0;
+	}
+}
@@ -0,0 +1,91 @@
+/*
+Room simulator for the host HAL
+Description: Kinematic differential-drive model of the cleaning robot. Integrates motor[motorLeft] and
+motor[motorRight] into a pose and synthesises the ultrasonic, gyro, colour and touch readings from the
+room geometry. SmuxDevice (smux_device.h) serves the three SMUX touch channels on S4.
+
+Robot layout (matches the missions' port map):
+	motorA left wheel, motorD right wheel, both mounted reversed; motorB drum, motorC spray
+	S1 ultrasonic on the right-hand side, facing right (the wall being followed)
+	S2 gyro, S3 colour sensor looking down ahead of the drum (or right bumper in the no-mux builds)
+	S4 SMUX: channel 1 side touch (right), channel 2 front-left bumper, channel 3 front-right bumper
+	   (or left bumper in the no-mux builds)
+*/
+
+#ifndef __SIM_H__
+#define __SIM_H__
+
+#include "robotc_hal.h"
+#include "room.h"
+
+enum SimBumper
+{
+	bumperSide = 0,
+	bumperLeft,
+	bumperRight,
+	kNumbOfBumpers
+};
+
+struct SimConfig
+{
+	SimConfig();
+
+	double wheelRadius;		 // cm, RADIUS in the missions
+	double wheelbase;		 // cm between wheel contact points
+	double bodyRadius;		 // cm, collision circle
+	double maxDegPerSec;	 // motor speed at power 100
+	double motorTau;		 // s, first order lag from power to speed
+	double colourOffset;	 // cm ahead of the wheel axis
+	double drumWidth;		 // cm swept across the robot
+	double drumDepth;		 // cm of floor under the drum along the robot
+	double drumOffset;		 // cm from the wheel axis to the drum centre
+	double gyroDriftPerMin;	 // deg/min of bias added to the gyro
+	double gyroScale;		 // gain error of the gyro
+	double motorMismatch;	 // fraction the right wheel runs slower than the left at the same power
+};
+
+struct SimPose
+{
+	double x, y;
+	double heading; // degrees counter-clockwise, unwrapped
+};
+
+class RoomSim : public HalWorld
+{
+public:
+	RoomSim(const Room &room, const SimConfig &config);
+
+	void start();
+	void step(float dt);
+	float motorDegrees(tMotor m);
+	float gyroDegrees();
+	float gyroRate();
+	int readSensor(tSensors port, TSensorTypes type);
+
+	bool touching(SimBumper bumper) const { return bumpers_[bumper]; }
+	int bumpCount(SimBumper bumper) const { return bumpCounts_[bumper]; }
+	bool started() const { return started_; }
+	const SimPose &pose() const { return pose_; }
+	int collisions() const { return collisions_; }
+	double elapsed() const { return elapsed_; }
+	const Room &room() const { return room_; }
+	const SimConfig &config() const { return config_; }
+
+private:
+	void updateContacts();
+	Vec2 offsetPoint(double forward, double left) const;
+
+	const Room &room_;
+	SimConfig config_;
+	SimPose pose_;
+	double speed_[kNumbOfRealMotors];	// deg/s
+	double degrees_[kNumbOfRealMotors]; // shaft angle
+	double gyroRate_, elapsed_;
+	double clearance_; // distance from the centre to the nearest wall at the current pose
+	bool started_, inContact_;
+	bool bumpers_[kNumbOfBumpers];
+	int bumpCounts_[kNumbOfBumpers];
+	int collisions_;
+};
+
+#endif // __SIM_H__
@@ -0,0 +1,158 @@
+#include "smux_device.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+
+const ubyte SMUX_ADDRESSES[kNumbOfBumpers] = {0xA0, 0xA2, 0xA4};
+const ubyte SMUX_CMD_REG = 0x52;
+const ubyte SMUX_DATA_REG = 0x54;
+const ubyte SMUX_MODE_TOUCH = 0x0F; // touchStateBump & 0x0F, what initSensor() writes
+
+// EV3 sensor-port I2C runs at roughly 9600 bit/s: about 0.94 ms per byte with its ACK
+SmuxTiming::SmuxTiming()
+	: setupUs(200), byteUs(940), jitterUs(300), pendingUs(1000), nakRate(0), stallRate(0), stallUs(50000)
+{
+}
+
+bool SmuxTiming::parse(const std::string &spec, std::string *error)
+{
+	std::istringstream list(spec);
+	std::string item;
+
+	while (std::getline(list, item, ','))
+	{
+		size_t equals = item.find('=');
+		if (equals == std::string::npos)
+		{
+			*error = "expected key=value in i2c timing: " + item;
+			return false;
+		}
+		std::string key = item.substr(0, equals);
+		const char *value = item.c_str() + equals + 1;
+
+		if (key == "setup")
+			setupUs = atol(value);
+		else if (key == "byte")
+			byteUs = atol(value);
+		else if (key == "jitter")
+			jitterUs = atol(value);
+		else if (key == "pending")
+			pendingUs = atol(value);
+		else if (key == "nak")
+			nakRate = atof(value);
+		else if (key == "stall")
+			stallRate = atof(value);
+		else if (key == "stall-us")
+			stallUs = atol(value);
+		else
+		{
+			*error = "unknown i2c timing key: " + key;
+			return false;
+		}
+	}
+	return true;
+}
+
+SmuxDevice::SmuxDevice(const RoomSim &sim, const SmuxTiming &timing, unsigned seed)
+	: sim_(sim), timing_(timing), random_(seed), transactions_(0), naks_(0), stalls_(0), busyUs_(0), missed_(0)
+{
+	for (int i = 0; i < kNumbOfBumpers; i++)
+	{
+		mode_[i] = SMUX_MODE_TOUCH;
+		wasTouching_[i] = false;
+		seenDown_[i] = true;
+		pressedAtUs_[i] = -1;
+	}
+}
+
+/**
+ * @brief Bus time of one transaction clocking the given number of bytes
+ *
+ * @param stalled set if the transaction hangs for stallUs
+ */
+long SmuxDevice::duration(int bytes, bool *stalled)
+{
+	long us = timing_.setupUs + bytes * timing_.byteUs + timing_.pendingUs;
+	if (timing_.jitterUs > 0)
+		us += std::uniform_int_distribution<long>(0, timing_.jitterUs)(random_);
+	if (timing_.stallRate > 0 && std::uniform_real_distribution<double>(0, 1)(random_) < timing_.stallRate)
+	{
+		stalls_++;
+		us += timing_.stallUs;
+		*stalled = true;
+	}
+	return us;
+}
+
+long SmuxDevice::transfer(const ubyte *msg, int msgLen, ubyte *reply, int replyLen)
+{
+	int channel = -1;
+	for (int i = 0; i < kNumbOfBumpers; i++)
+		if (msgLen >= 1 && msg[0] == SMUX_ADDRESSES[i])
+			channel = i;
+	if (channel < 0)
+		return -1;
+
+	transactions_++;
+	if (timing_.nakRate > 0 && std::uniform_real_distribution<double>(0, 1)(random_) < timing_.nakRate)
+	{
+		naks_++;
+		return -1;
+	}
+
+	// a read repeats the start condition and the address before clocking the reply in
+	bool stalled = false;
+	long us = duration(msgLen + (replyLen > 0 ? replyLen + 1 : 0), &stalled);
+	busyUs_ += us;
+
+	if (msgLen >= 3 && msg[1] == SMUX_CMD_REG)
+		mode_[channel] = msg[2];
+	else if (msgLen >= 2 && msg[1] == SMUX_DATA_REG && mode_[channel] == SMUX_MODE_TOUCH && replyLen >= 2)
+	{
+		bool touching = sim_.touching((SimBumper)channel);
+		reply[0] = touching ? 1 : 0;
+		reply[1] = (ubyte)sim_.bumpCount((SimBumper)channel);
+
+		// a stalled read is normally abandoned by the mission, so it does not count as reporting the press;
+		// any other read does, through the bumper state or else the bump count
+		if (!stalled)
+		{
+			if (pressedAtUs_[channel] >= 0)
+			{
+				touchLatencies_.push_back((long)(halNowUs() + us - pressedAtUs_[channel]));
+				pressedAtUs_[channel] = -1;
+			}
+			if (touching)
+				seenDown_[channel] = true;
+		}
+	}
+	return us;
+}
+
+/**
+ * @brief Note when each bumper is pressed, and presses released before a read saw the bumper down
+ */
+void SmuxDevice::tick(long long nowUs)
+{
+	for (int i = 0; i < kNumbOfBumpers; i++)
+	{
+		bool touching = sim_.touching((SimBumper)i);
+		if (touching && !wasTouching_[i])
+		{
+			pressedAtUs_[i] = nowUs;
+			seenDown_[i] = false;
+		}
+		else if (!touching && wasTouching_[i] && !seenDown_[i])
+			missed_++;
+		wasTouching_[i] = touching;
+	}
+}
+
+long percentile(std::vector<long> values, double q)
+{
+	if (values.empty())
+		return 0;
+	std::sort(values.begin(), values.end());
+	return values[(size_t)(q * (values.size() - 1) + 0.5)];
+}
@@ -0,0 +1,97 @@
+/*
+Simulated Mindsensors EV3 SMUX
+Description: Answers the SMUX's three I2C addresses (0xA0, 0xA2, 0xA4 for channels 1 to 3) on the
+simulated bus. A write to MSEV3_CMD_REG sets the channel's mode and a read of MSEV3_DATA_REG returns the
+reading of the sensor behind it; the robot's SMUX carries the three touch sensors, so touch mode answers
+with the bumper state and bump count from the room simulator.
+
+Every transaction is timed: start/address/stop overhead plus a cost per byte clocked in either
+direction, optional jitter, extra time the port keeps reading i2cStatusPending after the bytes are done,
+and rare NAKs or stalls. The device also measures touch-poll latency, from the moment a bumper is
+pressed in the simulation to the end of the first read that reports it, and counts the presses too short
+for any read to see the bumper down.
+*/
+
+#ifndef __SMUX_DEVICE_H__
+#define __SMUX_DEVICE_H__
+
+#include "sim.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+struct SmuxTiming
+{
+	SmuxTiming();
+
+	/**
+	 * @brief Override fields from a comma separated key=value list
+	 *
+	 * Keys are setup, byte, jitter, pending, stall-us (microseconds) and nak, stall (probability per
+	 * transaction), e.g. "byte=500,pending=2000,nak=0.001".
+	 * @return false with a message in error if the list does not parse
+	 */
+	bool parse(const std::string &spec, std::string *error);
+
+	long setupUs;	  // start condition, address byte and stop of every transaction
+	long byteUs;	  // each register, data or reply byte
+	long jitterUs;	  // uniformly distributed extra time, 0 to jitterUs
+	long pendingUs;	  // i2cStatusPending after the transfer itself has finished
+	double nakRate;	  // chance the device NAKs, leaving the port at i2cStatusFailed
+	double stallRate; // chance the transaction hangs pending for stallUs
+	long stallUs;
+};
+
+class SmuxDevice : public HalI2CDevice, public HalTicker
+{
+public:
+	SmuxDevice(const RoomSim &sim, const SmuxTiming &timing, unsigned seed);
+
+	long transfer(const ubyte *msg, int msgLen, ubyte *reply, int replyLen);
+	void tick(long long nowUs);
+
+	long transactions() const { return transactions_; }
+	long naks() const { return naks_; }
+	long stalls() const { return stalls_; }
+
+	/**
+	 * @brief Microseconds the bus spent busy (including pending time)
+	 */
+	long long busyUs() const { return busyUs_; }
+
+	/**
+	 * @brief Press-to-report latency of every touch the mission saw, in microseconds
+	 *
+	 * A press counts as reported by the first read after it, since the reply's bump count includes it
+	 * even once the bumper is released again.
+	 */
+	const std::vector<long> &touchLatencies() const { return touchLatencies_; }
+
+	/**
+	 * @brief Presses that ended before any read saw the bumper down, only visible in the bump count
+	 */
+	int touchesMissed() const { return missed_; }
+
+private:
+	long duration(int bytes, bool *stalled);
+
+	const RoomSim &sim_;
+	SmuxTiming timing_;
+	std::mt19937 random_;
+	ubyte mode_[kNumbOfBumpers];
+	bool wasTouching_[kNumbOfBumpers];
+	bool seenDown_[kNumbOfBumpers]; // a read has returned the current press with the bumper down
+	long long pressedAtUs_[kNumbOfBumpers]; // -1 once the press has been reported
+	long transactions_, naks_, stalls_;
+	long long busyUs_;
+	std::vector<long> touchLatencies_;
+	int missed_;
+};
+
+/**
+ * @brief Value at quantile q (0 to 1) of a sample, 0 when empty
+ */
+long percentile(std::vector<long> values, double q);
+
+#endif // __SMUX_DEVICE_H__
@@ -0,0 +1,117 @@
+/*
+Telemetry decoder
+Description: Turns the telemetry a mission saved with saveTelemetry() (UW_telemetry.c) into CSV, one row
+per sample with the time in seconds, the mission state, the four motor powers, both drive encoders,
+the gyro heading, the ultrasonic distance, the colour and the bumpers pressed. It reads the binary file
+the brick wrote as well as a debug stream log holding the "TLM" hex lines, so a run whose file could
+not be written can still be decoded from the log.
+
+Usage: bin/teledecode FILE
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+const int HEADER_BYTES = 16;
+const int VERSION = 1;
+
+/**
+ * @brief Little endian signed value of length bytes
+ */
+static long field(const unsigned char *bytes, int length)
+{
+	unsigned long value = 0;
+	for (int i = 0; i < length; i++)
+		value |= (unsigned long)bytes[i] << (8 * i);
+
+	// sign extend from the top bit of the field
+	unsigned long sign = 1UL << (8 * length - 1);
+	return (long)((value ^ sign) - sign);
+}
+
+/**
+ * @brief Bytes of a debug stream log's "TLM" lines, in order
+ */
+static std::vector<unsigned char> hexLines(const std::string &text)
+{
+	std::vector<unsigned char> bytes;
+	std::istringstream lines(text);
+	std::string line;
+
+	while (std::getline(lines, line))
+	{
+		size_t tag = line.find("TLM");
+		if (tag == std::string::npos)
+			continue;
+		std::istringstream hex(line.substr(tag + 3));
+		std::string byte;
+		while (hex >> byte)
+			bytes.push_back((unsigned char)strtoul(byte.c_str(), NULL, 16));
+	}
+	return bytes;
+}
+
+static int usage(const char *argv0)
+{
+	fprintf(stderr, "usage: %s FILE\n", argv0);
+	return 2;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc != 2)
+		return usage(argv[0]);
+
+	std::ifstream in(argv[1], std::ios::binary);
+	if (!in)
+	{
+		fprintf(stderr, "cannot read %s\n", argv[1]);
+		return 2;
+	}
+	std::string contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+	std::vector<unsigned char> bytes;
+	if (contents.compare(0, 4, "UWTL") == 0)
+		bytes.assign(contents.begin(), contents.end());
+	else
+		bytes = hexLines(contents);
+
+	if (bytes.size() < (size_t)HEADER_BYTES || memcmp(&bytes[0], "UWTL", 4) != 0)
+	{
+		fprintf(stderr, "%s: no telemetry found\n", argv[1]);
+		return 1;
+	}
+	const unsigned char *header = &bytes[0];
+	int version = header[4], sampleBytes = header[5];
+	long period = field(header + 6, 2), samples = field(header + 8, 4), overwritten = field(header + 12, 4);
+
+	if (version != VERSION || sampleBytes < 24)
+	{
+		fprintf(stderr, "%s: telemetry version %d with %d byte samples is not supported\n", argv[1], version,
+				sampleBytes);
+		return 1;
+	}
+	long available = (long)(bytes.size() - HEADER_BYTES) / sampleBytes;
+	if (available < samples)
+	{
+		fprintf(stderr, "%s: truncated, %ld of %ld samples\n", argv[1], available, samples);
+		samples = available;
+	}
+
+	printf("# %ld samples every %ld ms, %ld older samples overwritten\n", samples, period, overwritten);
+	printf("t,state,powerA,powerB,powerC,powerD,encoder_left,encoder_right,heading,distance,colour,touch\n");
+	for (long i = 0; i < samples; i++)
+	{
+		const unsigned char *s = &bytes[HEADER_BYTES + i * sampleBytes];
+		printf("%.3f,%ld,%d,%d,%d,%d,%ld,%ld,%.1f,%ld,%d,%d\n", field(s, 4) / 1e3, field(s + 22, 2),
+			   (signed char)s[16], (signed char)s[17], (signed char)s[18], (signed char)s[19], field(s + 4, 4),
+			   field(s + 8, 4), field(s + 12, 2) / 10.0, field(s + 14, 2), s[20], s[21]);
+	}
+	return 0;
+}
@@ -0,0 +1,64 @@
+#include "work_pool.h"
+
+#include <thread>
+
+WorkStealingPool::WorkStealingPool(int threads)
+{
+	if (threads <= 0)
+		threads = (int)std::thread::hardware_concurrency();
+	if (threads <= 0)
+		threads = 1;
+	for (int i = 0; i < threads; i++)
+		queues_.push_back(std::unique_ptr<Queue>(new Queue));
+}
+
+/**
+ * @brief Next job for a worker: newest of its own, otherwise the oldest of someone else's
+ */
+bool WorkStealingPool::take(int self, size_t *index)
+{
+	{
+		std::lock_guard<std::mutex> guard(queues_[self]->lock);
+		if (!queues_[self]->items.empty())
+		{
+			*index = queues_[self]->items.back();
+			queues_[self]->items.pop_back();
+			return true;
+		}
+	}
+
+	int n = threads();
+	for (int i = 1; i < n; i++)
+	{
+		Queue &victim = *queues_[(self + i) % n];
+		std::lock_guard<std::mutex> guard(victim.lock);
+		if (!victim.items.empty())
+		{
+			*index = victim.items.front();
+			victim.items.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+void WorkStealingPool::run(size_t count, const std::function<void(size_t)> &work)
+{
+	int n = threads();
+
+	// jobs are only added before the workers start, so an empty sweep means the batch is drained
+	for (size_t i = 0; i < count; i++)
+		queues_[i % n]->items.push_back(i);
+
+	std::vector<std::thread> workers;
+	for (int self = 0; self < n; self++)
+	{
+		workers.push_back(std::thread([this, self, &work]() {
+			size_t index;
+			while (take(self, &index))
+				work(index);
+		}));
+	}
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+}
@@ -0,0 +1,48 @@
+/*
+Work-stealing thread pool for the host tools
+Description: Each worker owns a deque of job indices. It pops from the back of its own deque and,
+once that is empty, steals from the front of the others', so uneven mission lengths still keep every
+core busy until the whole batch is done.
+*/
+
+#ifndef __WORK_POOL_H__
+#define __WORK_POOL_H__
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class WorkStealingPool
+{
+public:
+	/**
+	 * @brief Create a pool
+	 *
+	 * @param threads number of workers, or 0 for one per hardware thread
+	 */
+	explicit WorkStealingPool(int threads);
+
+	int threads() const { return (int)queues_.size(); }
+
+	/**
+	 * @brief Run work(i) for every i in [0, count) and return once all of them have finished
+	 *
+	 * work is called concurrently from the worker threads.
+	 */
+	void run(size_t count, const std::function<void(size_t)> &work);
+
+private:
+	struct Queue
+	{
+		std::mutex lock;
+		std::deque<size_t> items;
+	};
+
+	bool take(int self, size_t *index);
+
+	std::vector<std::unique_ptr<Queue> > queues_;
+};
+
+#endif // __WORK_POOL_H__
@@ -75,11 +75,15 @@ typedef struct
   bool presence;
   tEV3SensorTypeMode typeMode;
   ubyte _cmd;
+  tI2CTransaction _command;   /*!< mode command, built by initSensor() */
+  tI2CTransaction _read;      /*!< data register read for the mode, built by initSensor() */
 } tMSEV3, *tMSEV3Ptr;
 
 bool initSensor(tMSEV3Ptr msev3Ptr, tMUXSensor muxsensor, tEV3SensorTypeMode typeMode);
 bool readSensor(tMSEV3Ptr msev3Ptr);
 bool _sensorSendCommand(tMSEV3Ptr msev3Ptr);
+void _sensorPrepareRead(tMSEV3Ptr msev3Ptr);
+bool _sensorDecodeReply(tMSEV3Ptr msev3Ptr);
 
 /**
  * Initialise the sensor's data struct and port
@@ -90,7 +94,7 @@ bool _sensorSendCommand(tMSEV3Ptr msev3Ptr);
  */
 bool initSensor(tMSEV3Ptr msev3Ptr, tMUXSensor muxsensor, tEV3SensorTypeMode typeMode)
 {
-	memset(msev3Ptr, 0, sizeof(tMSEV3Ptr));
+	memset(msev3Ptr, 0, sizeof(tMSEV3));
 
 	switch (MPORT(muxsensor))
 	{
@@ -117,6 +121,12 @@ bool initSensor(tMSEV3Ptr msev3Ptr, tMUXSensor muxsensor, tEV3SensorTypeMode typ
     sleep(1000);
   }
 
+  // Build the command and the read once, this also checks the port
+  if (!initI2CTransaction(&msev3Ptr->_command, msev3Ptr->I2CData.port, msev3Ptr->I2CData.address, MSEV3_CMD_REG, 0))
+    return false;
+  addI2CByte(&msev3Ptr->_command, msev3Ptr->_cmd);
+  _sensorPrepareRead(msev3Ptr);
+
   return _sensorSendCommand(msev3Ptr);
   //return true;
 }
@@ -129,8 +139,23 @@ bool initSensor(tMSEV3Ptr msev3Ptr, tMUXSensor muxsensor, tEV3SensorTypeMode typ
  */
 bool readSensor(tMSEV3Ptr msev3Ptr)
 {
-  memset(msev3Ptr->I2CData.request, 0, sizeof(msev3Ptr->I2CData.request));
+  if (!transactI2C(&msev3Ptr->_read, &msev3Ptr->I2CData.reply[0]))
+  {
+    return false;
+  }
+
+  return _sensorDecodeReply(msev3Ptr);
+}
+
 
+/**
+ * Build the data register read for the sensor's mode, done once by initSensor()
+ *
+ * Note: this is an internal function and should not be called directly.
+ * @param msev3Ptr pointer to the sensor's data struct
+ */
+void _sensorPrepareRead(tMSEV3Ptr msev3Ptr)
+{
 	// Request only the number of bytes required.
  	switch(msev3Ptr->typeMode)
  	{
@@ -161,16 +186,20 @@ bool readSensor(tMSEV3Ptr msev3Ptr)
 	}
 
   // Read all of the data available on the sensor
-  msev3Ptr->I2CData.request[0] = 2;                    // Message size
-  msev3Ptr->I2CData.request[1] = msev3Ptr->I2CData.address; // I2C Address
-  msev3Ptr->I2CData.request[2] = MSEV3_DATA_REG;
-  msev3Ptr->I2CData.requestLen = 2;
+  initI2CTransaction(&msev3Ptr->_read, msev3Ptr->I2CData.port, msev3Ptr->I2CData.address, MSEV3_DATA_REG,
+    msev3Ptr->I2CData.replyLen);
+}
 
-  if (!writeI2C(&msev3Ptr->I2CData))
-  {
-    return false;
-  }
 
+/**
+ * Unpack the reply in I2CData into the sensor's data struct
+ *
+ * Note: this is an internal function and should not be called directly.
+ * @param msev3Ptr pointer to the sensor's data struct
+ * @return true if no error occured, false if it did
+ */
+bool _sensorDecodeReply(tMSEV3Ptr msev3Ptr)
+{
  	switch(msev3Ptr->typeMode)
  	{
  		case touchStateBump:
@@ -234,18 +263,7 @@ bool readSensor(tMSEV3Ptr msev3Ptr)
  * @return true if no error occured, false if it did
  */
 bool _sensorSendCommand(tMSEV3Ptr msev3Ptr) {
-  bool retVal = false;
-
-  memset(msev3Ptr->I2CData.request, 0, sizeof(msev3Ptr->I2CData.request));
-
-  msev3Ptr->I2CData.request[0] = 3;              						// Message size
-  msev3Ptr->I2CData.request[1] = msev3Ptr->I2CData.address; // I2C Address
-  msev3Ptr->I2CData.request[2] = MSEV3_CMD_REG;  						// Command register
-  msev3Ptr->I2CData.request[3] = msev3Ptr->_cmd;  					// Command to be sent
-
-  retVal = writeI2C(&msev3Ptr->I2CData);
-
-  return retVal;
+  return transactI2C(&msev3Ptr->_command, &msev3Ptr->I2CData.reply[0]);
 }
 
 